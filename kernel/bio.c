@@ -18,6 +18,7 @@
 #include "param.h"
 #include "spinlock.h"
 #include "sleeplock.h"
+#include "stats.h"
 #include "riscv.h"
 #include "defs.h"
 #include "fs.h"
@@ -67,6 +68,7 @@ bget(uint dev, uint blockno)
     if(b->dev == dev && b->blockno == blockno){
       b->refcnt++;
       release(&bcache.lock);
+      statinc(ST_BHIT);
       acquiresleep(&b->lock);
       return b;
     }
@@ -81,6 +83,7 @@ bget(uint dev, uint blockno)
       b->valid = 0;
       b->refcnt = 1;
       release(&bcache.lock);
+      statinc(ST_BMISS);
       acquiresleep(&b->lock);
       return b;
     }
@@ -21,6 +21,7 @@
 #include "riscv.h"
 #include "defs.h"
 #include "proc.h"
+#include "poll.h"
 
 #define BACKSPACE 0x100
 #define C(x)  ((x)-'@')  // Control-x
@@ -50,6 +51,8 @@ struct {
   uint r;  // Read index
   uint w;  // Write index
   uint e;  // Edit index
+
+  struct pollq pollq;  // poll()ers waiting for a line
 } cons;
 
 //
@@ -58,13 +61,17 @@ struct {
 int
 consolewrite(int user_src, uint64 src, int n)
 {
-  int i;
-
-  for(i = 0; i < n; i++){
-    char c;
-    if(either_copyin(&c, user_src, src+i, 1) == -1)
+  char buf[32];
+  int i, j, m;
+
+  for(i = 0; i < n; i += m){
+    m = n - i;
+    if(m > sizeof(buf))
+      m = sizeof(buf);
+    if(either_copyin(buf, user_src, src+i, m) == -1)
       break;
-    uartputc(c);
+    for(j = 0; j < m; j++)
+      uartputc(buf[j]);
   }
 
   return i;
@@ -81,7 +88,8 @@ consoleread(int user_dst, uint64 dst, int n)
 {
   uint target;
   int c;
-  char cbuf;
+  char cbuf[32];
+  int nbuf = 0;
 
   target = n;
   acquire(&cons.lock);
@@ -107,13 +115,19 @@ consoleread(int user_dst, uint64 dst, int n)
       break;
     }
 
-    // copy the input byte to the user-space buffer.
-    cbuf = c;
-    if(either_copyout(user_dst, dst, &cbuf, 1) == -1)
-      break;
-
-    dst++;
+    // collect input bytes, and copy them to the
+    // user-space buffer a batch at a time.
+    cbuf[nbuf++] = c;
     --n;
+    if(nbuf == sizeof(cbuf)){
+      if(either_copyout(user_dst, dst, cbuf, nbuf) == -1){
+        n += nbuf;
+        nbuf = 0;
+        break;
+      }
+      dst += nbuf;
+      nbuf = 0;
+    }
 
     if(c == '\n'){
       // a whole line has arrived, return to
@@ -121,6 +135,8 @@ consoleread(int user_dst, uint64 dst, int n)
       break;
     }
   }
+  if(nbuf > 0 && either_copyout(user_dst, dst, cbuf, nbuf) == -1)
+    n += nbuf;
   release(&cons.lock);
 
   return target - n;
@@ -170,6 +186,7 @@ consoleintr(int c)
         // has arrived.
         cons.w = cons.e;
         wakeup(&cons.r);
+        pollwake(&cons.pollq);
       }
     }
     break;
@@ -178,10 +195,29 @@ consoleintr(int c)
   release(&cons.lock);
 }
 
+//
+// poll() of the console: readable once a whole line
+// has arrived; writes never wait.
+//
+int
+consolepoll(struct pollq **q)
+{
+  int r = POLLOUT;
+
+  acquire(&cons.lock);
+  if(cons.r != cons.w)
+    r |= POLLIN;
+  release(&cons.lock);
+  if(q)
+    *q = &cons.pollq;
+  return r;
+}
+
 void
 consoleinit(void)
 {
   initlock(&cons.lock, "cons");
+  pollqinit(&cons.pollq);
 
   uartinit();
 
@@ -189,4 +225,5 @@ consoleinit(void)
   // to consoleread and consolewrite.
   devsw[CONSOLE].read = consoleread;
   devsw[CONSOLE].write = consolewrite;
+  devsw[CONSOLE].poll = consolepoll;
 }
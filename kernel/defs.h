@@ -2,10 +2,18 @@ struct buf;
 struct context;
 struct file;
 struct inode;
+struct kstats;
+struct vdata;
+struct lockstat;
 struct pipe;
+struct pollq;
+struct mm;
+struct pagebatch;
 struct proc;
 struct spinlock;
 struct sleeplock;
+struct slabcache;
+struct shm;
 struct stat;
 struct superblock;
 
@@ -33,6 +41,7 @@ void            fileinit(void);
 int             fileread(struct file*, uint64, int n);
 int             filestat(struct file*, uint64 addr);
 int             filewrite(struct file*, uint64, int n);
+int             filepoll(struct file*, struct pollq**);
 
 // fs.c
 void            fsinit(int);
@@ -59,10 +68,46 @@ void            ramdiskinit(void);
 void            ramdiskintr(void);
 void            ramdiskrw(struct buf*);
 
+// ipi.c
+void            ipi(int, int);
+int             ipiintr(void);
+void            tlbshootdown(struct mm*);
+
 // kalloc.c
 void*           kalloc(void);
 void            kfree(void *);
 void            kinit(void);
+void*           megaalloc(void);
+void            megafree(void *);
+void            kdup(void *);
+
+// pcache.c
+void            pcacheinit(void);
+void*           pcacheget(struct inode*, uint, uint);
+void            pcacheinval(struct inode*);
+char*           pcachelookup(struct inode*, uint);
+void*           pcachepage(struct inode*, uint);
+void            pcachewrite(struct inode*, uint, char*, uint);
+void            pcachedrop(struct inode*);
+
+// futex.c
+void            futexinit(void);
+int             futex(uint64, int, int);
+
+// shm.c
+void            shminit(void);
+struct shm*     shmget(int, int);
+void            shmclose(struct shm*);
+uint64          shmsize(struct shm*);
+void*           shmpage(struct shm*, uint64);
+
+// mmap.c
+uint64          mmap(uint64, int, int, struct file*, uint);
+int             munmap(uint64, uint64);
+int             vmafault(struct proc*, uint64, int);
+int             vmacopy(struct proc*, struct proc*);
+void            vmaunmapall(struct proc*);
+uint64          vmalow(struct proc*);
 
 // log.c
 void            initlog(int, struct superblock*);
@@ -71,10 +116,17 @@ void            begin_op(void);
 void            end_op(void);
 
 // pipe.c
+void            pipeinit(void);
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
-int             piperead(struct pipe*, uint64, int);
-int             pipewrite(struct pipe*, uint64, int);
+int             piperead(struct pipe*, uint64, int, int);
+int             pipewrite(struct pipe*, uint64, int, int);
+int             pipepoll(struct pipe*, int, struct pollq**);
+
+// poll.c
+void            pollqinit(struct pollq*);
+void            pollwake(struct pollq*);
+int             poll(uint64, int, int);
 
 // printf.c
 void            printf(char*, ...);
@@ -85,11 +137,15 @@ void            printfinit(void);
 int             cpuid(void);
 void            exit(int);
 int             fork(void);
-int             growproc(int);
+int             clone(uint64, uint64, uint64);
+int             join(int, uint64);
+uint64          growproc(int);
 void            proc_mapstacks(pagetable_t);
 pagetable_t     proc_pagetable(struct proc *);
 void            proc_freepagetable(pagetable_t, uint64);
 int             kill(int);
+int             setaffinity(int, uint);
+int             getaffinity(int);
 int             killed(struct proc*);
 void            setkilled(struct proc*);
 struct cpu*     mycpu(void);
@@ -102,14 +158,23 @@ void            sleep(void*, struct spinlock*);
 void            userinit(void);
 int             wait(uint64);
 void            wakeup(void*);
+int             wakeupn(void*, int);
 void            yield(void);
 int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
 void            procdump(void);
+struct file*    fdget(int);
+struct inode*   cwdget(void);
 
 // swtch.S
 void            swtch(struct context*, struct context*);
 
+// prof.c
+void            profinit(void);
+void            profsample(void);
+int             profctl(int);
+int             profread(uint64, int);
+
 // spinlock.c
 void            acquire(struct spinlock*);
 int             holding(struct spinlock*);
@@ -117,6 +182,24 @@ void            initlock(struct spinlock*, char*);
 void            release(struct spinlock*);
 void            push_off(void);
 void            pop_off(void);
+int             lockstatread(int, struct lockstat*);
+
+// slab.c
+void            slabinit(struct slabcache*, char*, uint, uint);
+void*           slaballoc(struct slabcache*);
+void            slabfree(struct slabcache*, void*);
+
+// sched.c
+void            schedinit(void);
+void            schedonline(void);
+uint            cpusonline(void);
+void            runqadd(struct proc*);
+int             runqrequeue(struct proc*);
+struct proc*    runqpop(void);
+int             runqempty(void);
+void            schedcharge(struct proc*);
+void            setrunnable(struct proc*);
+int             nice(int);
 
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
@@ -124,6 +207,12 @@ void            releasesleep(struct sleeplock*);
 int             holdingsleep(struct sleeplock*);
 void            initsleeplock(struct sleeplock*, char*);
 
+// stats.c
+extern struct vdata vdata;
+void            statadd(int, uint64);
+void            statinc(int);
+int             statread(int, struct kstats*);
+
 // string.c
 int             memcmp(const void*, const void*, uint);
 void*           memmove(void*, const void*, uint);
@@ -141,6 +230,21 @@ int             fetchstr(uint64, char*, int);
 int             fetchaddr(uint64, uint64*);
 void            syscall();
 
+// timer.c
+void            timersinit(void);
+void            timerset(void);
+void            timerexpire(uint64);
+int             sleepuntil(uint64);
+int             seqsleep(int*, int, uint64);
+void            seqwakeup(int*);
+
+// trace.c
+void            traceinit(void);
+void            traceset(struct proc*, uint64);
+void            tracerecord(struct proc*, int, uint64*, uint64, uint64);
+int             traceread(uint64, int);
+int             tracedropped(void);
+
 // trap.c
 extern uint     ticks;
 void            trapinit(void);
@@ -158,6 +262,8 @@ int             uartgetc(void);
 // vm.c
 void            kvminit(void);
 void            kvminithart(void);
+void            asidinit(void);
+uint64          uvmsatp(struct proc*);
 void            kvmmap(pagetable_t, uint64, uint64, uint64, int);
 int             mappages(pagetable_t, uint64, uint64, uint64, int);
 pagetable_t     uvmcreate(void);
@@ -170,9 +276,15 @@ void            uvmunmap(pagetable_t, uint64, uint64, int);
 void            uvmclear(pagetable_t, uint64);
 pte_t *         walk(pagetable_t, uint64, int);
 uint64          walkaddr(pagetable_t, uint64);
+void            uvmfaultin(pagetable_t, uint64, uint64, int);
 int             copyout(pagetable_t, uint64, char *, uint64);
 int             copyin(pagetable_t, char *, uint64, uint64);
 int             copyinstr(pagetable_t, char *, uint64, uint64);
+void            utlbflush(struct proc*);
+void            pagebatchinit(struct pagebatch*, pagetable_t);
+void            pagebatchadd(struct pagebatch*, uint64, int);
+void            pagebatchflush(struct pagebatch*);
+int             uvmfaultretry(struct proc*, uint64, int);
 
 // plic.c
 void            plicinit(void);
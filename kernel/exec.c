@@ -3,11 +3,13 @@
 #include "memlayout.h"
 #include "riscv.h"
 #include "spinlock.h"
+#include "sleeplock.h"
 #include "proc.h"
 #include "defs.h"
 #include "elf.h"
 
 static int loadseg(pde_t *, uint64, struct inode *, uint, uint);
+static int mapshared(pde_t *, uint64, struct inode *, uint, uint, int);
 
 int flags2perm(int flags)
 {
@@ -31,6 +33,11 @@ exec(char *path, char **argv)
   pagetable_t pagetable = 0, oldpagetable;
   struct proc *p = myproc();
 
+  // the other threads would lose their address space;
+  // they must exit, and be join()ed, first.
+  if(p->mm->ref > 1)
+    return -1;
+
   begin_op();
 
   if((ip = namei(path)) == 0){
@@ -61,6 +68,15 @@ exec(char *path, char **argv)
       goto bad;
     if(ph.vaddr % PGSIZE != 0)
       goto bad;
+    if((ph.flags & ELF_PROG_FLAG_WRITE) == 0 && ph.filesz == ph.memsz &&
+       ph.off % PGSIZE == 0 && ph.vaddr == PGROUNDUP(sz)){
+      // read-only and all from the file: share the
+      // pages with other processes running this program.
+      if(mapshared(pagetable, ph.vaddr, ip, ph.off, ph.filesz, flags2perm(ph.flags)) < 0)
+        goto bad;
+      sz = PGROUNDUP(ph.vaddr + ph.memsz);
+      continue;
+    }
     uint64 sz1;
     if((sz1 = uvmalloc(pagetable, sz, ph.vaddr + ph.memsz, flags2perm(ph.flags))) == 0)
       goto bad;
@@ -73,7 +89,7 @@ exec(char *path, char **argv)
   ip = 0;
 
   p = myproc();
-  uint64 oldsz = p->sz;
+  uint64 oldsz = p->mm->sz;
 
   // Allocate two pages at the next page boundary.
   // Make the first inaccessible as a stack guard.
@@ -121,9 +137,11 @@ exec(char *path, char **argv)
   safestrcpy(p->name, last, sizeof(p->name));
     
   // Commit to the user image.
+  vmaunmapall(p);
   oldpagetable = p->pagetable;
-  p->pagetable = pagetable;
-  p->sz = sz;
+  p->mm->pagetable = p->pagetable = pagetable;
+  utlbflush(p);
+  p->mm->sz = sz;
   p->trapframe->epc = elf.entry;  // initial program counter = main
   p->trapframe->sp = sp; // initial stack pointer
   proc_freepagetable(oldpagetable, oldsz);
@@ -164,3 +182,32 @@ loadseg(pagetable_t pagetable, uint64 va, struct inode *ip, uint offset, uint sz
   
   return 0;
 }
+
+// Map sz bytes of ip from offset onwards at virtual address va,
+// with pages from the text cache.  va and offset must be
+// page-aligned and the pages from va to va+sz must be unmapped.
+// Returns 0 on success, -1 on failure.
+static int
+mapshared(pagetable_t pagetable, uint64 va, struct inode *ip, uint offset, uint sz, int perm)
+{
+  uint i, n;
+  void *pa;
+
+  for(i = 0; i < sz; i += PGSIZE){
+    if(sz - i < PGSIZE)
+      n = sz - i;
+    else
+      n = PGSIZE;
+    if((pa = pcacheget(ip, offset+i, n)) == 0)
+      goto err;
+    if(mappages(pagetable, va + i, PGSIZE, (uint64)pa, PTE_R|PTE_U|perm) != 0){
+      kfree(pa);
+      goto err;
+    }
+  }
+  return 0;
+
+ err:
+  uvmunmap(pagetable, va, i / PGSIZE, 1);
+  return -1;
+}
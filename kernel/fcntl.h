@@ -3,3 +3,18 @@
 #define O_RDWR    0x002
 #define O_CREATE  0x200
 #define O_TRUNC   0x400
+#define O_NONBLOCK 0x800
+
+// fcntl() commands.
+#define F_GETFL   1
+#define F_SETFL   2   // only O_NONBLOCK can be changed
+
+// mmap() protection and flags.
+#define PROT_READ   0x1
+#define PROT_WRITE  0x2
+#define MAP_SHARED  0x1
+#define MAP_PRIVATE 0x2
+
+// futex() operations.
+#define FUTEX_WAIT  0
+#define FUTEX_WAKE  1
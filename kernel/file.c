@@ -12,17 +12,24 @@
 #include "file.h"
 #include "stat.h"
 #include "proc.h"
+#include "slab.h"
+#include "poll.h"
 
 struct devsw devsw[NDEV];
+
+// file structures come from a slab cache, so the number
+// of open files is limited only by memory. ftable.lock
+// protects the reference counts.
 struct {
   struct spinlock lock;
-  struct file file[NFILE];
+  struct slabcache cache;
 } ftable;
 
 void
 fileinit(void)
 {
   initlock(&ftable.lock, "ftable");
+  slabinit(&ftable.cache, "file", sizeof(struct file), NFILE);
 }
 
 // Allocate a file structure.
@@ -31,16 +38,11 @@ filealloc(void)
 {
   struct file *f;
 
-  acquire(&ftable.lock);
-  for(f = ftable.file; f < ftable.file + NFILE; f++){
-    if(f->ref == 0){
-      f->ref = 1;
-      release(&ftable.lock);
-      return f;
-    }
-  }
-  release(&ftable.lock);
-  return 0;
+  if((f = slaballoc(&ftable.cache)) == 0)
+    return 0;
+  memset(f, 0, sizeof(*f));
+  f->ref = 1;
+  return f;
 }
 
 // Increment ref count for file f.
@@ -72,6 +74,7 @@ fileclose(struct file *f)
   f->ref = 0;
   f->type = FD_NONE;
   release(&ftable.lock);
+  slabfree(&ftable.cache, f);
 
   if(ff.type == FD_PIPE){
     pipeclose(ff.pipe, ff.writable);
@@ -79,6 +82,8 @@ fileclose(struct file *f)
     begin_op();
     iput(ff.ip);
     end_op();
+  } else if(ff.type == FD_SHM){
+    shmclose(ff.shm);
   }
 }
 
@@ -111,17 +116,27 @@ fileread(struct file *f, uint64 addr, int n)
   if(f->readable == 0)
     return -1;
 
+  // fault in mmap()ed pages now: pipes and devices copy out
+  // with a spinlock held, and readi() with an inode locked.
+  if(f->type == FD_PIPE || f->type == FD_DEVICE || f->type == FD_INODE)
+    uvmfaultin(myproc()->pagetable, addr, n, 1);
+
   if(f->type == FD_PIPE){
-    r = piperead(f->pipe, addr, n);
+    r = piperead(f->pipe, addr, n, f->nonblock);
   } else if(f->type == FD_DEVICE){
     if(f->major < 0 || f->major >= NDEV || !devsw[f->major].read)
       return -1;
+    if(f->nonblock && devsw[f->major].poll &&
+       (devsw[f->major].poll(0) & POLLIN) == 0)
+      return -1;
     r = devsw[f->major].read(1, addr, n);
   } else if(f->type == FD_INODE){
     ilock(f->ip);
     if((r = readi(f->ip, 1, addr, f->off, n)) > 0)
       f->off += r;
     iunlock(f->ip);
+  } else if(f->type == FD_SHM){
+    return -1;  // use mmap()
   } else {
     panic("fileread");
   }
@@ -139,8 +154,13 @@ filewrite(struct file *f, uint64 addr, int n)
   if(f->writable == 0)
     return -1;
 
+  // fault in mmap()ed pages now: pipes copy in with a
+  // spinlock held, and writei() with an inode locked.
+  if(f->type == FD_PIPE || f->type == FD_INODE)
+    uvmfaultin(myproc()->pagetable, addr, n, 0);
+
   if(f->type == FD_PIPE){
-    ret = pipewrite(f->pipe, addr, n);
+    ret = pipewrite(f->pipe, addr, n, f->nonblock);
   } else if(f->type == FD_DEVICE){
     if(f->major < 0 || f->major >= NDEV || !devsw[f->major].write)
       return -1;
@@ -173,6 +193,8 @@ filewrite(struct file *f, uint64 addr, int n)
       i += r;
     }
     ret = (i == n ? n : -1);
+  } else if(f->type == FD_SHM){
+    return -1;  // use mmap()
   } else {
     panic("filewrite");
   }
@@ -180,3 +202,24 @@ filewrite(struct file *f, uint64 addr, int n)
   return ret;
 }
 
+// Which POLL* events are ready on f.  Sets *q to the
+// queue that will be woken when that changes, or to 0
+// if f never makes a reader or writer wait.
+int
+filepoll(struct file *f, struct pollq **q)
+{
+  int r, mask;
+
+  *q = 0;
+  mask = (f->readable ? POLLIN : 0) | (f->writable ? POLLOUT : 0);
+  if(f->type == FD_PIPE){
+    r = pipepoll(f->pipe, f->writable, q);
+  } else if(f->type == FD_DEVICE && f->major >= 0 && f->major < NDEV &&
+            devsw[f->major].poll){
+    r = devsw[f->major].poll(q);
+  } else {
+    r = POLLIN | POLLOUT;
+  }
+  return r & (mask | POLLHUP);
+}
+
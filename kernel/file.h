@@ -1,12 +1,14 @@
 struct file {
-  enum { FD_NONE, FD_PIPE, FD_INODE, FD_DEVICE } type;
+  enum { FD_NONE, FD_PIPE, FD_INODE, FD_DEVICE, FD_SHM } type;
   int ref; // reference count
   char readable;
   char writable;
+  char nonblock;     // O_NONBLOCK: fail reads and writes that would sleep
   struct pipe *pipe; // FD_PIPE
   struct inode *ip;  // FD_INODE and FD_DEVICE
   uint off;          // FD_INODE
   short major;       // FD_DEVICE
+  struct shm *shm;   // FD_SHM
 };
 
 #define major(dev)  ((dev) >> 16 & 0xFFFF)
@@ -20,6 +22,8 @@ struct inode {
   int ref;            // Reference count
   struct sleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
+  int pcached;        // may have pages in the text cache?
+  struct fpage *pages; // cached file pages, for mmap()
 
   short type;         // copy of disk inode
   short major;
@@ -27,12 +31,31 @@ struct inode {
   short nlink;
   uint size;
   uint addrs[NDIRECT+1];
+
+  struct inode *next;  // itable list; protected by itable.lock
+  struct inode *prev;
+};
+
+// processes in poll() waiting on a pipe or device.
+struct pollq {
+  struct spinlock lock;
+  struct pollwait *head;
+};
+
+// one poll() caller on one pollq; lives on the caller's stack.
+struct pollwait {
+  struct pollq *q;         // queue this is on, or 0
+  int *seq;                // the caller's p->pollseq
+  struct pollwait *next;
 };
 
 // map major device number to device functions.
+// poll, if set, returns the ready POLL* events and
+// sets *q (if q is not 0) to the queue to wait on.
 struct devsw {
   int (*read)(int, uint64, int);
   int (*write)(int, uint64, int);
+  int (*poll)(struct pollq **q);
 };
 
 extern struct devsw devsw[];
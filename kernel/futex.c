@@ -0,0 +1,77 @@
+// Futexes: sleeping for user-level synchronization.
+//
+// futex(addr, FUTEX_WAIT, val) sleeps if the int at user
+// address addr still holds val, and futex(addr, FUTEX_WAKE, n)
+// wakes up to n processes sleeping on addr.  The sleep channel
+// is the physical address of the int, so threads, and
+// processes that map the same page, meet on one channel
+// wherever each has the page mapped.
+//
+// A waker changes the int before it calls FUTEX_WAKE, and
+// futexlock is held from a waiter's check of the int until it
+// sleeps, so a wakeup cannot fall between the two.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "proc.h"
+#include "fcntl.h"
+#include "defs.h"
+
+struct spinlock futexlock;
+
+void
+futexinit(void)
+{
+  initlock(&futexlock, "futex");
+}
+
+// the kernel address of the int at user address addr,
+// faulting its page in if need be, or 0.
+static int*
+futexaddr(uint64 addr)
+{
+  struct proc *p = myproc();
+  uint64 pa;
+  int x;
+
+  if(addr % sizeof(int) != 0)
+    return 0;
+  if(copyin(p->pagetable, (char*)&x, addr, sizeof(x)) < 0)
+    return 0;
+  if((pa = walkaddr(p->pagetable, addr)) == 0)
+    return 0;
+  return (int*)(pa + addr % PGSIZE);
+}
+
+// FUTEX_WAIT returns 0 when woken (or killed), and -1 at once
+// if *addr != val.  FUTEX_WAKE returns the number woken.
+int
+futex(uint64 addr, int op, int val)
+{
+  int *kaddr, n;
+
+  if((kaddr = futexaddr(addr)) == 0)
+    return -1;
+
+  switch(op){
+  case FUTEX_WAIT:
+    acquire(&futexlock);
+    if(__atomic_load_n(kaddr, __ATOMIC_SEQ_CST) != val){
+      release(&futexlock);
+      return -1;
+    }
+    sleep(kaddr, &futexlock);
+    release(&futexlock);
+    return 0;
+  case FUTEX_WAKE:
+    acquire(&futexlock);
+    n = wakeupn(kaddr, val);
+    release(&futexlock);
+    return n;
+  }
+  return -1;
+}
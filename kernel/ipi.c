@@ -0,0 +1,90 @@
+// Inter-processor interrupts.
+//
+// A CPU interrupts another by setting the other's MSIP bit in
+// the CLINT.  That raises a machine-mode software interrupt,
+// which timervec in kernelvec.S clears and passes on as a
+// supervisor software interrupt, as it does for the timer.
+// The sender first ORs its reasons into the target's c->ipi,
+// which devintr() collects through ipiintr().
+//
+// IPI_WAKE needs nothing but the interrupt itself: it gets an
+// idle CPU out of wfi to look at its run queue, or makes a busy
+// one notice p->resched at the end of the trap.  IPI_TLB asks
+// for a TLB flush; see tlbshootdown().
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "proc.h"
+#include "stats.h"
+#include "defs.h"
+
+// Interrupt CPU cpu, for the IPI_* reasons in why.
+void
+ipi(int cpu, int why)
+{
+  __atomic_fetch_or(&cpus[cpu].ipi, why, __ATOMIC_SEQ_CST);
+  *(volatile uint32*)CLINT_MSIP(cpu) = 1;
+}
+
+// Collect this CPU's pending IPIs.  Called by devintr() for
+// every supervisor software interrupt, since the timer raises
+// them too.  Returns 1 if there were any.
+int
+ipiintr(void)
+{
+  struct cpu *c = mycpu();
+  uint req;
+  int why;
+
+  why = __atomic_exchange_n(&c->ipi, 0, __ATOMIC_SEQ_CST);
+  if(why == 0)
+    return 0;
+  statinc(ST_IPI);
+  if(why & IPI_TLB){
+    // read the count before flushing, so that the flush
+    // covers every page-table change made before it.
+    req = __atomic_load_n(&c->tlbreq, __ATOMIC_ACQUIRE);
+    sfence_vma();
+    __atomic_store_n(&c->tlbdone, req, __ATOMIC_RELEASE);
+  }
+  return 1;
+}
+
+// Make the other CPUs that are running threads of mm flush
+// their TLBs, and wait until they have, so that no user code
+// can still reach pages just unmapped.  CPUs that start a
+// thread of mm later flush in uvmsatp(), since the caller has
+// already marked mm->tlbstale with utlbflush().  Must be
+// called with interrupts on: a target CPU may be spinning, with
+// interrupts off, for a lock the caller would otherwise hold.
+void
+tlbshootdown(struct mm *mm)
+{
+  struct proc *q;
+  uint want[NCPU];
+  uint64 sent = 0;
+  int i, me;
+
+  if(!intr_get())
+    panic("tlbshootdown");
+  push_off();
+  me = cpuid();
+  for(i = 0; i < NCPU; i++){
+    q = __atomic_load_n(&cpus[i].proc, __ATOMIC_SEQ_CST);
+    if(i == me || q == 0 || q->mm != mm)
+      continue;
+    want[i] = __atomic_add_fetch(&cpus[i].tlbreq, 1, __ATOMIC_SEQ_CST);
+    ipi(i, IPI_TLB);
+    sent |= 1L << i;
+  }
+  pop_off();
+
+  for(i = 0; i < NCPU; i++)
+    if(sent & (1L << i))
+      while((int)(__atomic_load_n(&cpus[i].tlbdone, __ATOMIC_ACQUIRE) - want[i]) < 0)
+        ;
+}
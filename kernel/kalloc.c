@@ -1,12 +1,21 @@
 // Physical memory allocator, for user processes,
 // kernel stacks, page-table pages,
-// and pipe buffers. Allocates whole 4096-byte pages.
+// and slab caches. Allocates whole 4096-byte pages.
+//
+// The top NMEGAPAGE*2 MB of RAM is kept as a pool of
+// megapages for large user heaps (see uvmalloc()).  If the
+// page list runs dry, kalloc() breaks up a megapage.
+//
+// A 4096-byte page can be shared, e.g. program text mapped
+// by several processes: kdup() adds a reference, and kfree()
+// frees the page only when it drops the last one.
 
 #include "types.h"
 #include "param.h"
 #include "memlayout.h"
 #include "spinlock.h"
 #include "riscv.h"
+#include "stats.h"
 #include "defs.h"
 
 void freerange(void *pa_start, void *pa_end);
@@ -21,13 +30,20 @@ struct run {
 struct {
   struct spinlock lock;
   struct run *freelist;
+  struct run *megalist;  // free 2 MB megapages
+  ushort ref[(PHYSTOP - KERNBASE) / PGSIZE];  // of allocated pages
 } kmem;
 
+#define MEGABASE (PHYSTOP - NMEGAPAGE*MEGAPGSIZE)
+#define PAREF(pa) kmem.ref[((uint64)(pa) - KERNBASE) / PGSIZE]
+
 void
 kinit()
 {
   initlock(&kmem.lock, "kmem");
-  freerange(end, (void*)PHYSTOP);
+  freerange(end, (void*)MEGABASE);
+  for(uint64 pa = MEGABASE; pa < PHYSTOP; pa += MEGAPGSIZE)
+    megafree((void*)pa);
 }
 
 void
@@ -51,6 +67,15 @@ kfree(void *pa)
   if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
     panic("kfree");
 
+  acquire(&kmem.lock);
+  if(PAREF(pa) > 1){
+    PAREF(pa)--;
+    release(&kmem.lock);
+    return;
+  }
+  PAREF(pa) = 0;
+  release(&kmem.lock);
+
   // Fill with junk to catch dangling refs.
   memset(pa, 1, PGSIZE);
 
@@ -60,6 +85,7 @@ kfree(void *pa)
   r->next = kmem.freelist;
   kmem.freelist = r;
   release(&kmem.lock);
+  statinc(ST_KFREE);
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -71,12 +97,75 @@ kalloc(void)
   struct run *r;
 
   acquire(&kmem.lock);
+  if(kmem.freelist == 0 && kmem.megalist){
+    // out of pages; split a megapage.
+    char *m = (char*)kmem.megalist;
+    kmem.megalist = kmem.megalist->next;
+    for(char *p = m; p < m + MEGAPGSIZE; p += PGSIZE){
+      r = (struct run*)p;
+      r->next = kmem.freelist;
+      kmem.freelist = r;
+    }
+  }
   r = kmem.freelist;
-  if(r)
+  if(r){
     kmem.freelist = r->next;
+    PAREF(r) = 1;
+  }
   release(&kmem.lock);
 
-  if(r)
+  if(r){
     memset((char*)r, 5, PGSIZE); // fill with junk
+    statinc(ST_KALLOC);
+  }
+  return (void*)r;
+}
+
+// Add a reference to the page at pa, which must
+// have been returned by kalloc().
+void
+kdup(void *pa)
+{
+  if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
+    panic("kdup");
+
+  acquire(&kmem.lock);
+  if(PAREF(pa) == 0 || PAREF(pa) == 0xffff)
+    panic("kdup: ref");
+  PAREF(pa)++;
+  release(&kmem.lock);
+}
+
+// Free a 2 MB megapage returned by megaalloc().
+void
+megafree(void *pa)
+{
+  struct run *r;
+
+  if(((uint64)pa % MEGAPGSIZE) != 0 || (uint64)pa < MEGABASE || (uint64)pa >= PHYSTOP)
+    panic("megafree");
+
+  r = (struct run*)pa;
+
+  acquire(&kmem.lock);
+  r->next = kmem.megalist;
+  kmem.megalist = r;
+  release(&kmem.lock);
+}
+
+// Allocate one physically contiguous, 2 MB-aligned
+// megapage.  Returns 0 if none is free.  Unlike kalloc(),
+// does not junk-fill: callers zero the page themselves.
+void *
+megaalloc(void)
+{
+  struct run *r;
+
+  acquire(&kmem.lock);
+  r = kmem.megalist;
+  if(r)
+    kmem.megalist = r->next;
+  release(&kmem.lock);
+
   return (void*)r;
 }
@@ -19,14 +19,23 @@ main()
     kinit();         // physical page allocator
     kvminit();       // create kernel page table
     kvminithart();   // turn on paging
+    asidinit();      // address-space IDs
     procinit();      // process table
+    schedinit();     // run queue
+    futexinit();     // futex wait channels
     trapinit();      // trap vectors
+    timersinit();    // one-shot timers
     trapinithart();  // install kernel trap vector
     plicinit();      // set up interrupt controller
     plicinithart();  // ask PLIC for device interrupts
     binit();         // buffer cache
     iinit();         // inode table
+    pcacheinit();    // program text cache
     fileinit();      // file table
+    pipeinit();      // pipe cache
+    shminit();       // shared-memory segments
+    profinit();      // sampling profiler
+    traceinit();     // system call tracing
     virtio_disk_init(); // emulated hard disk
     userinit();      // first user process
     __sync_synchronize();
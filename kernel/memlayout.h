@@ -25,10 +25,14 @@
 #define VIRTIO0 0x10001000
 #define VIRTIO0_IRQ 1
 
-// core local interruptor (CLINT), which contains the timer.
+// core local interruptor (CLINT), which contains the timer
+// and each hart's machine software interrupt (MSIP) bit.
 #define CLINT 0x2000000L
+#define CLINT_MSIP(hartid) (CLINT + 4*(hartid))
 #define CLINT_MTIMECMP(hartid) (CLINT + 0x4000 + 8*(hartid))
 #define CLINT_MTIME (CLINT + 0xBFF8) // cycles since boot.
+#define TIMEBASE 10000000L  // mtime and time CSR ticks per second.
+#define TICKINTERVAL (TIMEBASE / HZ)  // cycles per scheduler tick.
 
 // qemu puts platform-level interrupt controller (PLIC) here.
 #define PLIC 0x0c000000L
@@ -62,6 +66,22 @@
 //   fixed-size stack
 //   expandable heap
 //   ...
-//   TRAPFRAME (p->trapframe, used by the trampoline)
+//   mmap()ed files, allocated downwards from MMAPTOP
+//   VDATA (read-only kernel data shared by all processes)
+//   USYSCALL (read-only per-process data)
+//   NTHREAD trapframe slots, one per thread (p->trapframe,
+//     used by the trampoline); the first thread's at TRAPFRAME
 //   TRAMPOLINE (the same page as in the kernel)
 #define TRAPFRAME (TRAMPOLINE - PGSIZE)
+#define TFSLOT(i) (TRAPFRAME - (i)*PGSIZE)
+#define USYSCALL (TRAPFRAME - NTHREAD*PGSIZE)
+#define NVDATA 2   // pages in struct vdata (kernel/stats.h)
+#define VDATA (USYSCALL - NVDATA*PGSIZE)
+#define MMAPTOP VDATA
+
+#ifndef __ASSEMBLER__
+// what a process can learn about itself without a system call.
+struct usyscall {
+  int pid;
+};
+#endif
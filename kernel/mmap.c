@@ -0,0 +1,322 @@
+// Memory-mapped files.
+//
+// mmap() records a virtual memory area (struct vma) in the
+// process and maps nothing; the first touch of each page
+// faults, and vmafault() maps the file's page from the page
+// cache (see pcache.c).  MAP_SHARED mappings map the cached
+// page itself, so they see, and make, changes to the file;
+// stores reach the disk when the page is unmapped.  Writable
+// MAP_PRIVATE mappings get a copy of the page.  Shared-memory
+// segments (see shm.c) are mapped the same way, from the
+// segment's pages instead of the page cache.
+//
+// Areas are placed top-down from MMAPTOP, below the lowest
+// existing one; the heap may not grow into them.
+//
+// The areas belong to the address space (struct mm), so the
+// threads of a process share them.  mm->vmlock serializes
+// mmap() and munmap() with each other and with sbrk(); faults
+// don't take it, since munmap() locks inodes to write pages
+// back.  A fault that would lock an inode fails if its thread
+// already holds one, so system calls that copy with an inode
+// locked fault their pages in first.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "proc.h"
+#include "fs.h"
+#include "file.h"
+#include "fcntl.h"
+#include "defs.h"
+
+// the area of p containing va, or 0.
+static struct vma*
+findvma(struct proc *p, uint64 va)
+{
+  struct vma *v;
+
+  for(v = p->mm->vma; v < &p->mm->vma[NVMA]; v++)
+    if(v->f && va >= v->addr && va < v->addr + v->len)
+      return v;
+  return 0;
+}
+
+// lowest address used by p's areas.
+// caller must hold p->mm->vmlock.
+uint64
+vmalow(struct proc *p)
+{
+  struct vma *v;
+  uint64 low = MMAPTOP;
+
+  for(v = p->mm->vma; v < &p->mm->vma[NVMA]; v++)
+    if(v->f && v->addr < low)
+      low = v->addr;
+  return low;
+}
+
+// Map len bytes of f from offset off.  Returns the
+// address, or -1.
+uint64
+mmap(uint64 len, int prot, int flags, struct file *f, uint off)
+{
+  struct proc *p = myproc();
+  struct mm *mm = p->mm;
+  struct vma *v, *slot = 0;
+  uint64 addr;
+
+  if(len == 0 || off % PGSIZE != 0)
+    return -1;
+  if(f->type != FD_INODE && f->type != FD_SHM)
+    return -1;
+  if(f->type == FD_SHM && off + len > shmsize(f->shm))
+    return -1;
+  if((flags & (MAP_SHARED|MAP_PRIVATE)) == 0 ||
+     (flags & (MAP_SHARED|MAP_PRIVATE)) == (MAP_SHARED|MAP_PRIVATE))
+    return -1;
+  if(!f->readable || ((flags & MAP_SHARED) && (prot & PROT_WRITE) && !f->writable))
+    return -1;
+
+  acquiresleep(&mm->vmlock);
+  for(v = mm->vma; v < &mm->vma[NVMA]; v++)
+    if(v->f == 0)
+      slot = v;
+  len = PGROUNDUP(len);
+  addr = vmalow(p);
+  if(slot == 0 || addr < len || addr - len < PGROUNDUP(mm->sz)){
+    releasesleep(&mm->vmlock);
+    return -1;
+  }
+  addr -= len;
+
+  v = slot;
+  v->addr = addr;
+  v->len = len;
+  v->prot = prot;
+  v->flags = flags;
+  v->off = off;
+  v->f = filedup(f);
+  releasesleep(&mm->vmlock);
+  return addr;
+}
+
+// write the page at va, mapped at pa, back to the file.
+static void
+writeback(struct vma *v, uint64 va, uint64 pa)
+{
+  struct inode *ip = v->f->ip;
+  uint off = v->off + (va - v->addr);
+  int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
+  uint i, n;
+
+  for(i = 0; i < PGSIZE; i += n){
+    n = PGSIZE - i < max ? PGSIZE - i : max;
+    begin_op();
+    ilock(ip);
+    if(off + i < ip->size){
+      if(n > ip->size - (off + i))
+        n = ip->size - (off + i);
+      writei(ip, 0, pa + i, off + i, n);
+    } else {
+      n = PGSIZE - i;  // past the end of the file
+    }
+    iunlock(ip);
+    end_op();
+  }
+}
+
+// Unmap the pages of v from addr to addr+len, writing
+// shared ones back to the file if they are dirty and
+// dowrite is set, and shrink v accordingly.  The range
+// must be at the start or the end of v.
+static void
+vmaunmap(struct proc *p, struct vma *v, uint64 addr, uint64 len, int dowrite)
+{
+  uint64 a, pa;
+  pte_t *pte;
+  struct pagebatch b;
+
+  pagebatchinit(&b, p->pagetable);
+  for(a = addr; a < addr + len; a += PGSIZE){
+    if((pte = walk(p->pagetable, a, 0)) == 0 || (*pte & PTE_V) == 0)
+      continue;
+    pa = PTE2PA(*pte);
+    if(dowrite && (v->flags & MAP_SHARED) && (*pte & PTE_D) &&
+       v->f->type == FD_INODE)
+      writeback(v, a, pa);
+    *pte = 0;
+    pagebatchadd(&b, pa, 0);
+  }
+  utlbflush(p);
+  pagebatchflush(&b);
+
+  if(addr == v->addr){
+    v->addr += len;
+    v->off += len;
+  }
+  v->len -= len;
+  if(v->len == 0){
+    fileclose(v->f);
+    v->f = 0;
+  }
+}
+
+// Unmap len bytes at addr.  The range must lie in one area,
+// at its start or its end.  Returns 0, or -1.
+int
+munmap(uint64 addr, uint64 len)
+{
+  struct proc *p = myproc();
+  struct vma *v;
+  int r = -1;
+
+  if(addr % PGSIZE != 0 || len == 0)
+    return -1;
+  len = PGROUNDUP(len);
+  acquiresleep(&p->mm->vmlock);
+  if((v = findvma(p, addr)) != 0 && addr + len <= v->addr + v->len &&
+     (addr == v->addr || addr + len == v->addr + v->len)){
+    vmaunmap(p, v, addr, len, 1);
+    r = 0;
+  }
+  releasesleep(&p->mm->vmlock);
+  return r;
+}
+
+// Unmap all of p's areas, as for exit() and exec().
+void
+vmaunmapall(struct proc *p)
+{
+  struct vma *v;
+
+  acquiresleep(&p->mm->vmlock);
+  for(v = p->mm->vma; v < &p->mm->vma[NVMA]; v++)
+    if(v->f)
+      vmaunmap(p, v, v->addr, v->len, 1);
+  releasesleep(&p->mm->vmlock);
+}
+
+// Copy p's areas to the child np, as for fork():
+// shared and read-only pages are shared, the others
+// copied.  Returns 0, or -1 with none copied.
+int
+vmacopy(struct proc *p, struct proc *np)
+{
+  struct vma *v, *nv;
+  uint64 a, pa;
+  pte_t *pte;
+  char *mem;
+
+  for(v = p->mm->vma, nv = np->mm->vma; v < &p->mm->vma[NVMA]; v++, nv++){
+    if(v->f == 0)
+      continue;
+    *nv = *v;
+    nv->f = filedup(v->f);
+    for(a = v->addr; a < v->addr + v->len; a += PGSIZE){
+      if((pte = walk(p->pagetable, a, 0)) == 0 || (*pte & PTE_V) == 0)
+        continue;
+      pa = PTE2PA(*pte);
+      if((v->flags & MAP_SHARED) || (*pte & PTE_W) == 0){
+        kdup((void*)pa);
+      } else {
+        if((mem = kalloc()) == 0)
+          goto err;
+        memmove(mem, (char*)pa, PGSIZE);
+        pa = (uint64)mem;
+      }
+      if(mappages(np->pagetable, a, PGSIZE, pa, PTE_FLAGS(*pte)) != 0){
+        kfree((void*)pa);
+        goto err;
+      }
+    }
+  }
+  return 0;
+
+ err:
+  // the child has written nothing, so there is nothing to
+  // write back; the parent's references keep the files open.
+  for(nv = np->mm->vma; nv < &np->mm->vma[NVMA]; nv++)
+    if(nv->f)
+      vmaunmap(np, nv, nv->addr, nv->len, 0);
+  return -1;
+}
+
+// Handle a page fault at va in one of p's areas.  write is
+// set for a store.  Returns 0 if the page is now mapped, -1
+// if the access is not allowed.
+int
+vmafault(struct proc *p, uint64 va, int write)
+{
+  struct vma *v;
+  struct inode *ip;
+  char *pa, *mem;
+  pte_t *pte;
+  int perm;
+
+  if((v = findvma(p, va)) == 0)
+    return -1;
+  // reading the file may sleep: not from a copyout() under
+  // a spinlock, as in piperead().  fileread() and filewrite()
+  // fault such pages in with uvmfaultin() first.
+  if(mycpu()->noff > 0)
+    return -1;
+  if(write && (v->prot & PROT_WRITE) == 0)
+    return -1;
+  if((v->prot & PROT_READ) == 0)
+    return -1;
+  va = PGROUNDDOWN(va);
+  if((pte = walk(p->pagetable, va, 0)) != 0 && (*pte & PTE_V))
+    // mapped, perhaps by another thread just now.
+    return write && (*pte & PTE_W) == 0 ? -1 : 0;
+
+  if(v->f->type == FD_SHM){
+    if((pa = shmpage(v->f->shm, v->off + (va - v->addr))) == 0)
+      return -1;
+  } else {
+    // not with an inode locked, as by readi() into a page
+    // that a racing munmap() has just unmapped: two processes
+    // reading files into each other's mappings would each
+    // hold one inode lock and wait for the other.
+    if(p->ilocks > 0)
+      return -1;
+    ip = v->f->ip;
+    ilock(ip);
+    pa = pcachepage(ip, v->off + (va - v->addr));
+    iunlock(ip);
+    if(pa == 0)
+      return -1;
+  }
+
+  perm = PTE_R | PTE_U;
+  if(v->prot & PROT_WRITE){
+    perm |= PTE_W;
+    if(v->flags & MAP_PRIVATE){
+      if((mem = kalloc()) == 0){
+        kfree(pa);
+        return -1;
+      }
+      memmove(mem, pa, PGSIZE);
+      kfree(pa);
+      pa = mem;
+    }
+  }
+  acquire(&p->mm->lock);
+  if((pte = walk(p->pagetable, va, 0)) != 0 && (*pte & PTE_V)){
+    // another thread faulted the page in first.
+    release(&p->mm->lock);
+    kfree(pa);
+    return 0;
+  }
+  if(mappages(p->pagetable, va, PGSIZE, (uint64)pa, perm) != 0){
+    release(&p->mm->lock);
+    kfree(pa);
+    return -1;
+  }
+  release(&p->mm->lock);
+  utlbflush(p);  // a hart may have cached the invalid PTE
+  return 0;
+}
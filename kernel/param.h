@@ -1,8 +1,8 @@
 #define NPROC        64  // maximum number of processes
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
-#define NFILE       100  // open files per system
-#define NINODE       50  // maximum number of active i-nodes
+#define NFILE       100  // open files reserved at boot; grows on demand
+#define NINODE       50  // active i-nodes reserved at boot; grows on demand
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
@@ -11,3 +11,15 @@
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
 #define FSSIZE       2000  // size of file system in blocks
 #define MAXPATH      128   // maximum file path name
+#define NPROFSAMPLE 256  // per-CPU profiler ring size
+#define NTRACEREC   128  // per-CPU syscall trace ring size
+#define NLOCKCLASS   64  // distinct lock names tracked by LOCKSTAT
+#define NMEGAPAGE    8     // 2 MB pages set aside for large user heaps
+#define NPCACHE    256     // pages in the shared program text cache
+#define NVMA        16     // mmap()ed areas per process
+#define NTHREAD      8     // threads per process
+#define NSHM        16     // shared-memory segments
+#define NSHMPAGE   256     // pages per shared-memory segment
+#ifndef HZ
+#define HZ           10    // timer ticks per second; make HZ=n to change
+#endif
@@ -0,0 +1,205 @@
+// Page caches for file contents.
+//
+// Text pages: exec() maps text pages from this cache, shared,
+// into every process running the same program, instead of
+// reading a private copy for each.  A page is identified by
+// (device, inode number, file offset, length); bytes past the
+// length are zero.  The cache holds a reference to each of its
+// pages (see kdup()), so a page lives until the cache and every
+// process mapping it have let go.  Writing or truncating a file
+// drops its text pages; processes already running keep their
+// mappings.  When the cache is full, new pages replace old
+// ones round-robin.
+//
+// File pages: each in-memory inode keeps a list of whole pages
+// of its contents, for mmap() (see mmap.c).  Unlike text pages
+// these track the file: writei() updates them along with the
+// buffer cache, and readi() reads from them in preference to
+// the buffer cache, since a shared mapping may have changed
+// them.  They last until the file is truncated or the inode
+// leaves memory.
+
+#include "types.h"
+#include "param.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "stats.h"
+#include "slab.h"
+#include "defs.h"
+
+struct {
+  struct spinlock lock;
+  struct pcpage {
+    uint dev;
+    uint inum;
+    uint off;
+    uint n;        // bytes from the file
+    void *pa;      // 0 if this entry is free
+  } page[NPCACHE];
+  int hand;        // next entry to replace
+} pcache;
+
+struct fpage {
+  uint off;            // file offset, page-aligned
+  char *pa;
+  struct fpage *next;  // on ip->pages
+};
+
+struct slabcache fpages;
+
+void
+pcacheinit(void)
+{
+  initlock(&pcache.lock, "pcache");
+  slabinit(&fpages, "fpage", sizeof(struct fpage), 0);
+}
+
+// Return a page holding n bytes of ip from offset off,
+// followed by zeros, with a reference for the caller;
+// 0 if out of memory or the file cannot be read.
+// Caller must hold ip->lock, so no other process can
+// be adding the same page.
+void*
+pcacheget(struct inode *ip, uint off, uint n)
+{
+  struct pcpage *e;
+  void *pa, *old;
+
+  acquire(&pcache.lock);
+  for(e = pcache.page; e < &pcache.page[NPCACHE]; e++){
+    if(e->pa && e->dev == ip->dev && e->inum == ip->inum &&
+       e->off == off && e->n == n){
+      pa = e->pa;
+      kdup(pa);
+      release(&pcache.lock);
+      statinc(ST_PCHIT);
+      return pa;
+    }
+  }
+  release(&pcache.lock);
+
+  statinc(ST_PCMISS);
+  if((pa = kalloc()) == 0)
+    return 0;
+  memset((char*)pa + n, 0, PGSIZE - n);
+  if(readi(ip, 0, (uint64)pa, off, n) != n){
+    kfree(pa);
+    return 0;
+  }
+
+  kdup(pa);  // the cache's reference
+  ip->pcached = 1;
+  acquire(&pcache.lock);
+  e = &pcache.page[pcache.hand];
+  pcache.hand = (pcache.hand + 1) % NPCACHE;
+  old = e->pa;
+  e->dev = ip->dev;
+  e->inum = ip->inum;
+  e->off = off;
+  e->n = n;
+  e->pa = pa;
+  release(&pcache.lock);
+  if(old)
+    kfree(old);
+  return pa;
+}
+
+// Drop ip's pages from the cache, before its
+// contents change.  Caller must hold ip->lock.
+void
+pcacheinval(struct inode *ip)
+{
+  struct pcpage *e;
+  void *pa;
+
+  acquire(&pcache.lock);
+  for(e = pcache.page; e < &pcache.page[NPCACHE]; e++){
+    if(e->pa && e->dev == ip->dev && e->inum == ip->inum){
+      pa = e->pa;
+      e->pa = 0;
+      // kfree() does not sleep, but keep the
+      // lock out of the allocator anyway.
+      release(&pcache.lock);
+      kfree(pa);
+      acquire(&pcache.lock);
+    }
+  }
+  release(&pcache.lock);
+  ip->pcached = 0;
+}
+
+// Return ip's cached page for file offset off (page-aligned),
+// or 0.  Caller must hold ip->lock.
+char*
+pcachelookup(struct inode *ip, uint off)
+{
+  struct fpage *fp;
+
+  for(fp = ip->pages; fp; fp = fp->next)
+    if(fp->off == off)
+      return fp->pa;
+  return 0;
+}
+
+// Return ip's page for file offset off (page-aligned), reading
+// it if it is not cached, with a reference for the caller; 0 if
+// out of memory or the file cannot be read.  Bytes past the end
+// of the file are zero.  Caller must hold ip->lock.
+void*
+pcachepage(struct inode *ip, uint off)
+{
+  struct fpage *fp;
+  char *pa;
+  uint n = 0;
+
+  if((pa = pcachelookup(ip, off)) != 0){
+    kdup(pa);
+    statinc(ST_PCHIT);
+    return pa;
+  }
+
+  statinc(ST_PCMISS);
+  if((pa = kalloc()) == 0)
+    return 0;
+  if(off < ip->size)
+    n = ip->size - off < PGSIZE ? ip->size - off : PGSIZE;
+  memset(pa + n, 0, PGSIZE - n);
+  if(readi(ip, 0, (uint64)pa, off, n) != n || (fp = slaballoc(&fpages)) == 0){
+    kfree(pa);
+    return 0;
+  }
+  kdup(pa);  // the inode's reference
+  fp->off = off;
+  fp->pa = pa;
+  fp->next = ip->pages;
+  ip->pages = fp;
+  return pa;
+}
+
+// writei() has put n bytes from src at offset off of ip,
+// within one page; update the cached copy, if any.
+void
+pcachewrite(struct inode *ip, uint off, char *src, uint n)
+{
+  char *pa;
+
+  if((pa = pcachelookup(ip, PGROUNDDOWN(off))) != 0)
+    memmove(pa + off % PGSIZE, src, n);
+}
+
+// Drop all of ip's file pages, when it is truncated or
+// leaves memory.
+void
+pcachedrop(struct inode *ip)
+{
+  struct fpage *fp;
+
+  while((fp = ip->pages) != 0){
+    ip->pages = fp->next;
+    kfree(fp->pa);
+    slabfree(&fpages, fp);
+  }
+}
@@ -0,0 +1,144 @@
+// poll(): wait for any of several files to become ready.
+//
+// A pipe or device that can make a reader or writer wait
+// keeps a struct pollq of the processes poll()ing it.  poll()
+// puts a struct pollwait on the queue of each file it watches,
+// then checks every file again before it sleeps; pollwake()
+// bumps each waiter's p->pollseq, so a file that becomes ready
+// between the check and the sleep still ends the sleep.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "proc.h"
+#include "fs.h"
+#include "file.h"
+#include "poll.h"
+#include "defs.h"
+
+void
+pollqinit(struct pollq *q)
+{
+  initlock(&q->lock, "pollq");
+  q->head = 0;
+}
+
+static void
+polladd(struct pollq *q, struct pollwait *w)
+{
+  acquire(&q->lock);
+  w->q = q;
+  w->next = q->head;
+  q->head = w;
+  release(&q->lock);
+}
+
+static void
+polldel(struct pollwait *w)
+{
+  struct pollq *q = w->q;
+  struct pollwait **pp;
+
+  acquire(&q->lock);
+  for(pp = &q->head; *pp != w; pp = &(*pp)->next)
+    ;
+  *pp = w->next;
+  release(&q->lock);
+  w->q = 0;
+}
+
+// Wake the processes poll()ing q.  Called by the owner of q,
+// after a change that may have made it ready, with the lock
+// that protects that change held.  A poller that has not yet
+// made it onto q will see the change when it checks again.
+void
+pollwake(struct pollq *q)
+{
+  struct pollwait *w;
+
+  if(q->head == 0)
+    return;
+  acquire(&q->lock);
+  for(w = q->head; w; w = w->next)
+    seqwakeup(w->seq);
+  release(&q->lock);
+}
+
+// Wait until one of the nfds struct pollfds at user addr has
+// one of its events ready, or timeout milliseconds pass (a
+// negative timeout waits forever).  Fills in every revents and
+// returns how many are non-zero, or -1 on error or if killed.
+int
+poll(uint64 addr, int nfds, int timeout)
+{
+  struct proc *p = myproc();
+  struct pollfd fds[NOFILE];
+  struct pollwait w[NOFILE];
+  struct file *f[NOFILE];
+  struct pollq *q;
+  uint64 when;
+  int i, n, seq, waiting;
+
+  if(nfds < 0 || nfds > NOFILE)
+    return -1;
+  if(copyin(p->pagetable, (char*)fds, addr, nfds*sizeof(fds[0])) < 0)
+    return -1;
+  if(timeout < 0)
+    when = ~0ULL;
+  else
+    when = r_time() + (uint64)timeout * (TIMEBASE/1000);
+
+  // hold a reference to each file, so that a close()
+  // by another thread cannot free a pipe we wait on.
+  for(i = 0; i < nfds; i++){
+    f[i] = 0;
+    w[i].q = 0;
+    w[i].seq = &p->pollseq;
+    f[i] = fdget(fds[i].fd);
+  }
+
+  for(;;){
+    seq = __atomic_load_n(&p->pollseq, __ATOMIC_SEQ_CST);
+    n = 0;
+    waiting = 0;
+    for(i = 0; i < nfds; i++){
+      fds[i].revents = 0;
+      if(fds[i].fd < 0)
+        continue;
+      if(f[i] == 0){
+        fds[i].revents = POLLNVAL;
+      } else {
+        fds[i].revents = filepoll(f[i], &q) & (fds[i].events | POLLHUP);
+        if(q && w[i].q == 0){
+          polladd(q, &w[i]);
+          waiting = 1;
+        }
+      }
+      if(fds[i].revents)
+        n++;
+    }
+    if(n > 0 || r_time() >= when)
+      break;
+    // a file added to its queue just now may have become
+    // ready after it was checked; check once more.
+    if(waiting)
+      continue;
+    if(seqsleep(&p->pollseq, seq, when) < 0){
+      n = -1;
+      break;
+    }
+  }
+
+  for(i = 0; i < nfds; i++){
+    if(w[i].q)
+      polldel(&w[i]);
+    if(f[i])
+      fileclose(f[i]);
+  }
+  if(n >= 0 && copyout(p->pagetable, addr, (char*)fds, nfds*sizeof(fds[0])) < 0)
+    return -1;
+  return n;
+}
@@ -0,0 +1,11 @@
+// poll() events.
+#define POLLIN    0x01   // data to read, or end of file
+#define POLLOUT   0x04   // room to write
+#define POLLHUP   0x10   // other end closed (always reported)
+#define POLLNVAL  0x20   // fd not open (always reported)
+
+struct pollfd {
+  int fd;         // file to watch; ignored if negative
+  short events;   // POLLIN and/or POLLOUT
+  short revents;  // events that are ready, set by poll()
+};
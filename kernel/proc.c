@@ -3,7 +3,10 @@
 #include "memlayout.h"
 #include "riscv.h"
 #include "spinlock.h"
+#include "sleeplock.h"
 #include "proc.h"
+#include "stats.h"
+#include "slab.h"
 #include "defs.h"
 
 struct cpu cpus[NCPU];
@@ -15,6 +18,9 @@ struct proc *initproc;
 int nextpid = 1;
 struct spinlock pid_lock;
 
+struct slabcache mms;  // struct mm
+struct slabcache filetabs;  // struct files
+
 extern void forkret(void);
 static void freeproc(struct proc *p);
 
@@ -51,6 +57,8 @@ procinit(void)
   
   initlock(&pid_lock, "nextpid");
   initlock(&wait_lock, "wait_lock");
+  slabinit(&mms, "mm", sizeof(struct mm), 0);
+  slabinit(&filetabs, "files", sizeof(struct files), 0);
   for(p = proc; p < &proc[NPROC]; p++) {
       initlock(&p->lock, "proc");
       p->state = UNUSED;
@@ -124,22 +132,21 @@ allocproc(void)
 found:
   p->pid = allocpid();
   p->state = USED;
-
-  // Allocate a trapframe page.
+  p->nice = 0;
+  p->vruntime = 0;
+  p->resched = 0;
+  p->affinity = ~0;
+  p->cpu = cpuid();
+  p->rqidx = -1;
+
+  // Allocate a trapframe page.  The caller gives the
+  // process an address space, with mmalloc() or clone().
   if((p->trapframe = (struct trapframe *)kalloc()) == 0){
     freeproc(p);
     release(&p->lock);
     return 0;
   }
 
-  // An empty user page table.
-  p->pagetable = proc_pagetable(p);
-  if(p->pagetable == 0){
-    freeproc(p);
-    release(&p->lock);
-    return 0;
-  }
-
   // Set up new context to start executing at forkret,
   // which returns to user space.
   memset(&p->context, 0, sizeof(p->context));
@@ -149,30 +156,192 @@ found:
   return p;
 }
 
+// Give p a new address space of its own, with no user
+// memory, as for fork() and userinit().
+// Returns 0, or -1 if out of memory.
+static int
+mmalloc(struct proc *p)
+{
+  struct mm *mm;
+
+  if((mm = slaballoc(&mms)) == 0)
+    return -1;
+  memset(mm, 0, sizeof(*mm));
+  initlock(&mm->lock, "mm");
+  initsleeplock(&mm->vmlock, "vm");
+  mm->ref = 1;
+  mm->tfslots = 1 << 0;
+
+  // Allocate the page user code reads its pid from.
+  if((mm->usyscall = (struct usyscall *)kalloc()) == 0){
+    slabfree(&mms, mm);
+    return -1;
+  }
+  memset(mm->usyscall, 0, PGSIZE);
+  mm->usyscall->pid = p->pid;
+
+  // An empty user page table.
+  p->mm = mm;
+  p->tfslot = 0;
+  if((mm->pagetable = proc_pagetable(p)) == 0){
+    kfree((void*)mm->usyscall);
+    slabfree(&mms, mm);
+    p->mm = 0;
+    return -1;
+  }
+  p->pagetable = mm->pagetable;
+  return 0;
+}
+
+// Drop p's reference to its address space, unmapping
+// p's trapframe.  The last reference frees the page
+// table and the user memory.
+static void
+mmput(struct proc *p)
+{
+  struct mm *mm = p->mm;
+  int ref;
+
+  acquire(&mm->lock);
+  ref = --mm->ref;
+  release(&mm->lock);
+
+  if(ref > 0){
+    uvmunmap(mm->pagetable, TFSLOT(p->tfslot), 1, 0);
+    utlbflush(p);  // other threads' harts may cache the old slot
+    acquire(&mm->lock);
+    mm->tfslots &= ~(1 << p->tfslot);
+    release(&mm->lock);
+  } else {
+    proc_freepagetable(mm->pagetable, mm->sz);
+    kfree((void*)mm->usyscall);
+    slabfree(&mms, mm);
+  }
+}
+
+// Give p an empty file table of its own, with no cwd.
+// Returns 0, or -1 if out of memory.
+static int
+filesalloc(struct proc *p)
+{
+  struct files *fs;
+
+  if((fs = slaballoc(&filetabs)) == 0)
+    return -1;
+  memset(fs, 0, sizeof(*fs));
+  initlock(&fs->lock, "files");
+  fs->ref = 1;
+  p->files = fs;
+  return 0;
+}
+
+// Give np a copy of p's file table, as for fork(): the
+// same open files and current directory, but its own
+// descriptors.  Returns 0, or -1 if out of memory.
+static int
+filescopy(struct proc *np, struct proc *p)
+{
+  int i;
+
+  if(filesalloc(np) < 0)
+    return -1;
+  acquire(&p->files->lock);
+  for(i = 0; i < NOFILE; i++)
+    if(p->files->ofile[i])
+      np->files->ofile[i] = filedup(p->files->ofile[i]);
+  np->files->cwd = idup(p->files->cwd);
+  release(&p->files->lock);
+  return 0;
+}
+
+// Drop p's reference to its file table.  The last
+// reference closes the files and the current directory.
+static void
+filesput(struct proc *p)
+{
+  struct files *fs = p->files;
+  int fd, ref;
+
+  acquire(&fs->lock);
+  ref = --fs->ref;
+  release(&fs->lock);
+  p->files = 0;
+  if(ref > 0)
+    return;
+
+  for(fd = 0; fd < NOFILE; fd++)
+    if(fs->ofile[fd])
+      fileclose(fs->ofile[fd]);
+
+  begin_op();
+  iput(fs->cwd);
+  end_op();
+  slabfree(&filetabs, fs);
+}
+
+// Return the file open as descriptor fd in the current
+// process, with a new reference for the caller to drop
+// with fileclose(), or 0 if fd is not open.  Another thread
+// may close fd at any time, so p->files->ofile[fd] alone
+// is only safe while no other thread shares the table.
+struct file*
+fdget(int fd)
+{
+  struct files *fs = myproc()->files;
+  struct file *f = 0;
+
+  if(fd < 0 || fd >= NOFILE)
+    return 0;
+  acquire(&fs->lock);
+  if(fs->ofile[fd])
+    f = filedup(fs->ofile[fd]);
+  release(&fs->lock);
+  return f;
+}
+
+// Return the current directory, with a new reference,
+// so that a chdir() by another thread cannot free it.
+struct inode*
+cwdget(void)
+{
+  struct files *fs = myproc()->files;
+  struct inode *ip;
+
+  acquire(&fs->lock);
+  ip = idup(fs->cwd);
+  release(&fs->lock);
+  return ip;
+}
+
 // free a proc structure and the data hanging from it,
-// including user pages.
+// including user pages if no other thread shares them.
 // p->lock must be held.
 static void
 freeproc(struct proc *p)
 {
+  if(p->mm)
+    mmput(p);
+  p->mm = 0;
+  p->pagetable = 0;
   if(p->trapframe)
     kfree((void*)p->trapframe);
   p->trapframe = 0;
-  if(p->pagetable)
-    proc_freepagetable(p->pagetable, p->sz);
-  p->pagetable = 0;
-  p->sz = 0;
+  utlbflush(p);
+  p->isthread = 0;
+  p->tfslot = 0;
   p->pid = 0;
   p->parent = 0;
   p->name[0] = 0;
   p->chan = 0;
   p->killed = 0;
   p->xstate = 0;
+  p->tracemask = 0;
   p->state = UNUSED;
 }
 
 // Create a user page table for a given process, with no user memory,
-// but with trampoline and trapframe pages.
+// but with trampoline and trapframe pages, and the USYSCALL and
+// VDATA pages.
 pagetable_t
 proc_pagetable(struct proc *p)
 {
@@ -194,14 +363,32 @@ proc_pagetable(struct proc *p)
   }
 
   // map the trapframe page just below the trampoline page, for
-  // trampoline.S.
-  if(mappages(pagetable, TRAPFRAME, PGSIZE,
+  // trampoline.S, in the process's slot (0 unless it has threads).
+  if(mappages(pagetable, TFSLOT(p->tfslot), PGSIZE,
               (uint64)(p->trapframe), PTE_R | PTE_W) < 0){
     uvmunmap(pagetable, TRAMPOLINE, 1, 0);
     uvmfree(pagetable, 0);
     return 0;
   }
 
+  // map the per-process and the shared read-only pages
+  // below it, for getpid() and uptime() in ulib.c.
+  if(mappages(pagetable, USYSCALL, PGSIZE,
+              (uint64)(p->mm->usyscall), PTE_R | PTE_U) < 0){
+    uvmunmap(pagetable, TRAMPOLINE, 1, 0);
+    uvmunmap(pagetable, TFSLOT(p->tfslot), 1, 0);
+    uvmfree(pagetable, 0);
+    return 0;
+  }
+  if(mappages(pagetable, VDATA, NVDATA*PGSIZE,
+              (uint64)&vdata, PTE_R | PTE_U) < 0){
+    uvmunmap(pagetable, TRAMPOLINE, 1, 0);
+    uvmunmap(pagetable, TFSLOT(p->tfslot), 1, 0);
+    uvmunmap(pagetable, USYSCALL, 1, 0);
+    uvmfree(pagetable, 0);
+    return 0;
+  }
+
   return pagetable;
 }
 
@@ -210,8 +397,15 @@ proc_pagetable(struct proc *p)
 void
 proc_freepagetable(pagetable_t pagetable, uint64 sz)
 {
+  pte_t *pte;
+  int i;
+
   uvmunmap(pagetable, TRAMPOLINE, 1, 0);
-  uvmunmap(pagetable, TRAPFRAME, 1, 0);
+  for(i = 0; i < NTHREAD; i++)
+    if((pte = walk(pagetable, TFSLOT(i), 0)) != 0 && (*pte & PTE_V))
+      uvmunmap(pagetable, TFSLOT(i), 1, 0);
+  uvmunmap(pagetable, USYSCALL, 1, 0);
+  uvmunmap(pagetable, VDATA, NVDATA, 0);
   uvmfree(pagetable, sz);
 }
 
@@ -236,42 +430,58 @@ userinit(void)
 
   p = allocproc();
   initproc = p;
+  if(mmalloc(p) < 0)
+    panic("userinit");
   
   // allocate one user page and copy initcode's instructions
   // and data into it.
   uvmfirst(p->pagetable, initcode, sizeof(initcode));
-  p->sz = PGSIZE;
+  p->mm->sz = PGSIZE;
 
   // prepare for the very first "return" from kernel to user.
   p->trapframe->epc = 0;      // user program counter
   p->trapframe->sp = PGSIZE;  // user stack pointer
 
   safestrcpy(p->name, "initcode", sizeof(p->name));
-  p->cwd = namei("/");
+  if(filesalloc(p) < 0)
+    panic("userinit");
+  p->files->cwd = namei("/");
 
-  p->state = RUNNABLE;
+  setrunnable(p);
 
   release(&p->lock);
 }
 
 // Grow or shrink user memory by n bytes.
-// Return 0 on success, -1 on failure.
-int
+// Return the old size, read under the same lock as the
+// change so that threads calling sbrk() at once each get
+// their own memory, or -1 on failure.
+uint64
 growproc(int n)
 {
-  uint64 sz;
+  uint64 sz, oldsz;
   struct proc *p = myproc();
+  struct mm *mm = p->mm;
 
-  sz = p->sz;
+  acquiresleep(&mm->vmlock);
+  sz = oldsz = mm->sz;
   if(n > 0){
-    if((sz = uvmalloc(p->pagetable, sz, sz + n, PTE_W)) == 0) {
+    if(sz + n > vmalow(p)){
+      releasesleep(&mm->vmlock);
       return -1;
     }
+    if((sz = uvmalloc(p->pagetable, sz, sz + n, PTE_W|PTE_MEGA)) == 0) {
+      releasesleep(&mm->vmlock);
+      return -1;
+    }
+    // a hart may have cached the old, invalid PTEs.
+    utlbflush(p);
   } else if(n < 0){
     sz = uvmdealloc(p->pagetable, sz, sz + n);
   }
-  p->sz = sz;
-  return 0;
+  mm->sz = sz;
+  releasesleep(&mm->vmlock);
+  return oldsz;
 }
 
 // Create a new process, copying the parent.
@@ -279,22 +489,53 @@ growproc(int n)
 int
 fork(void)
 {
-  int i, pid;
+  int pid;
+  uint64 sz;
   struct proc *np;
   struct proc *p = myproc();
 
+  // keep other threads from changing the address space
+  // while it is copied.  a sleeplock, so take it before
+  // allocproc() returns holding np->lock.
+  acquiresleep(&p->mm->vmlock);
+  sz = p->mm->sz;
+
   // Allocate process.
   if((np = allocproc()) == 0){
+    releasesleep(&p->mm->vmlock);
+    return -1;
+  }
+  if(mmalloc(np) < 0){
+    freeproc(np);
+    release(&np->lock);
+    releasesleep(&p->mm->vmlock);
     return -1;
   }
 
   // Copy user memory from parent to child.
-  if(uvmcopy(p->pagetable, np->pagetable, p->sz) < 0){
+  if(uvmcopy(p->pagetable, np->pagetable, sz) < 0){
+    freeproc(np);
+    release(&np->lock);
+    releasesleep(&p->mm->vmlock);
+    return -1;
+  }
+  np->mm->sz = sz;
+
+  // and mmap()ed files.
+  if(vmacopy(p, np) < 0){
+    freeproc(np);
+    release(&np->lock);
+    releasesleep(&p->mm->vmlock);
+    return -1;
+  }
+  releasesleep(&p->mm->vmlock);
+
+  // copy the file table, taking references on open files.
+  if(filescopy(np, p) < 0){
     freeproc(np);
     release(&np->lock);
     return -1;
   }
-  np->sz = p->sz;
 
   // copy saved user registers.
   *(np->trapframe) = *(p->trapframe);
@@ -302,13 +543,10 @@ fork(void)
   // Cause fork to return 0 in the child.
   np->trapframe->a0 = 0;
 
-  // increment reference counts on open file descriptors.
-  for(i = 0; i < NOFILE; i++)
-    if(p->ofile[i])
-      np->ofile[i] = filedup(p->ofile[i]);
-  np->cwd = idup(p->cwd);
-
   safestrcpy(np->name, p->name, sizeof(p->name));
+  traceset(np, p->tracemask);
+  np->nice = p->nice;
+  np->affinity = p->affinity;
 
   pid = np->pid;
 
@@ -319,12 +557,171 @@ fork(void)
   release(&wait_lock);
 
   acquire(&np->lock);
-  np->state = RUNNABLE;
+  setrunnable(np);
   release(&np->lock);
 
   return pid;
 }
 
+// Create a new thread in the current process.  It shares
+// the caller's address space, open files and current
+// directory, and starts at fn(arg) with its stack pointer
+// at stack.
+// Returns the new thread's ID, a pid, or -1.
+int
+clone(uint64 fn, uint64 arg, uint64 stack)
+{
+  int slot, tid;
+  struct proc *np;
+  struct proc *p = myproc();
+  struct mm *mm = p->mm;
+
+  if((np = allocproc()) == 0){
+    return -1;
+  }
+
+  // Find a trapframe slot, and map the new thread's
+  // trapframe there for trampoline.S.
+  acquire(&mm->lock);
+  for(slot = 0; slot < NTHREAD; slot++)
+    if((mm->tfslots & (1 << slot)) == 0)
+      break;
+  if(slot < NTHREAD)
+    mm->tfslots |= 1 << slot;
+  release(&mm->lock);
+  if(slot == NTHREAD ||
+     mappages(mm->pagetable, TFSLOT(slot), PGSIZE,
+              (uint64)np->trapframe, PTE_R | PTE_W) < 0){
+    if(slot < NTHREAD){
+      acquire(&mm->lock);
+      mm->tfslots &= ~(1 << slot);
+      release(&mm->lock);
+    }
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
+  acquire(&mm->lock);
+  mm->ref++;
+  release(&mm->lock);
+  np->mm = mm;
+  np->pagetable = mm->pagetable;
+  np->tfslot = slot;
+  np->isthread = 1;
+
+  // start at fn(arg), with the caller's other registers.
+  *(np->trapframe) = *(p->trapframe);
+  np->trapframe->epc = fn;
+  np->trapframe->a0 = arg;
+  np->trapframe->sp = stack;
+
+  acquire(&p->files->lock);
+  p->files->ref++;
+  release(&p->files->lock);
+  np->files = p->files;
+
+  safestrcpy(np->name, p->name, sizeof(p->name));
+  traceset(np, p->tracemask);
+  np->nice = p->nice;
+  np->affinity = p->affinity;
+
+  tid = np->pid;
+
+  release(&np->lock);
+
+  acquire(&wait_lock);
+  np->parent = p;
+  release(&wait_lock);
+
+  acquire(&np->lock);
+  setrunnable(np);
+  release(&np->lock);
+
+  return tid;
+}
+
+// Wait for thread tid of the current process to exit and
+// return tid, copying its exit status to addr if non-zero.
+// Return -1 if there is no such thread.
+int
+join(int tid, uint64 addr)
+{
+  struct proc *pp;
+  int found;
+  struct proc *p = myproc();
+
+  acquire(&wait_lock);
+
+  for(;;){
+    found = 0;
+    for(pp = proc; pp < &proc[NPROC]; pp++){
+      if(pp == p || pp->mm != p->mm || pp->pid != tid)
+        continue;
+      acquire(&pp->lock);
+      if(pp->mm == p->mm && pp->pid == tid && pp->isthread){
+        found = 1;
+        if(pp->state == ZOMBIE){
+          if(addr != 0 && copyout(p->pagetable, addr, (char *)&pp->xstate,
+                                  sizeof(pp->xstate)) < 0) {
+            release(&pp->lock);
+            release(&wait_lock);
+            return -1;
+          }
+          freeproc(pp);
+          release(&pp->lock);
+          release(&wait_lock);
+          return tid;
+        }
+      }
+      release(&pp->lock);
+    }
+
+    if(!found || killed(p)){
+      release(&wait_lock);
+      return -1;
+    }
+
+    // Wait for a thread to exit.
+    sleep(p->mm, &wait_lock);
+  }
+}
+
+// Kill the other threads sharing p's address space, wait
+// for them to exit, and free them.  Called when a process's
+// first thread exits, so that the rest of exit() finds the
+// address space unshared.
+static void
+endthreads(struct proc *p)
+{
+  struct proc *pp;
+  int n;
+
+  acquire(&wait_lock);
+  for(;;){
+    n = 0;
+    for(pp = proc; pp < &proc[NPROC]; pp++){
+      if(pp == p || pp->mm != p->mm)
+        continue;
+      acquire(&pp->lock);
+      if(pp->mm == p->mm){
+        if(pp->state == ZOMBIE){
+          freeproc(pp);
+        } else {
+          pp->killed = 1;
+          if(pp->state == SLEEPING)
+            setrunnable(pp);
+          n++;
+        }
+      }
+      release(&pp->lock);
+    }
+    if(n == 0)
+      break;
+    sleep(p->mm, &wait_lock);
+  }
+  release(&wait_lock);
+}
+
 // Pass p's abandoned children to init.
 // Caller must hold wait_lock.
 void
@@ -343,6 +740,9 @@ reparent(struct proc *p)
 // Exit the current process.  Does not return.
 // An exited process remains in the zombie state
 // until its parent calls wait().
+// A thread made by clone() exits alone, and remains
+// a zombie until another thread calls join(); the
+// first thread takes the others with it.
 void
 exit(int status)
 {
@@ -351,27 +751,28 @@ exit(int status)
   if(p == initproc)
     panic("init exiting");
 
-  // Close all open files.
-  for(int fd = 0; fd < NOFILE; fd++){
-    if(p->ofile[fd]){
-      struct file *f = p->ofile[fd];
-      fileclose(f);
-      p->ofile[fd] = 0;
-    }
+  traceset(p, 0);
+
+  if(!p->isthread){
+    endthreads(p);
+
+    // Write back and unmap mmap()ed files.
+    vmaunmapall(p);
   }
 
-  begin_op();
-  iput(p->cwd);
-  end_op();
-  p->cwd = 0;
+  // Close all open files, unless other threads still use them.
+  filesput(p);
 
   acquire(&wait_lock);
 
   // Give any children to init.
   reparent(p);
 
-  // Parent might be sleeping in wait().
+  // Parent might be sleeping in wait(), and
+  // other threads in join() or endthreads().
   wakeup(p->parent);
+  if(p->isthread)
+    wakeup(p->mm);
   
   acquire(&p->lock);
 
@@ -400,7 +801,7 @@ wait(uint64 addr)
     // Scan through table looking for exited children.
     havekids = 0;
     for(pp = proc; pp < &proc[NPROC]; pp++){
-      if(pp->parent == p){
+      if(pp->parent == p && !pp->isthread){
         // make sure the child isn't still in exit() or swtch().
         acquire(&pp->lock);
 
@@ -437,7 +838,8 @@ wait(uint64 addr)
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
 // Scheduler never returns.  It loops, doing:
-//  - choose a process to run.
+//  - choose a process to run: the one with the
+//    least vruntime (see sched.c).
 //  - swtch to start running that process.
 //  - eventually that process transfers control
 //    via swtch back to the scheduler.
@@ -446,35 +848,65 @@ scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
+  uint64 t0;
   
   c->proc = 0;
+  schedonline();
   for(;;){
     // Avoid deadlock by ensuring that devices can interrupt.
     intr_on();
 
-    int found_runnable = 0;
-    for(p = proc; p < &proc[NPROC]; p++) {
-      acquire(&p->lock);
-      if(p->state == RUNNABLE) {
-        // Switch to chosen process.  It is the process's job
-        // to release its lock and then reacquire it
-        // before jumping back to us.
-        p->state = RUNNING;
-        c->proc = p;
-        swtch(&c->context, &p->context);
-
-        // Process is done running for now.
-        // It should have changed its p->state before coming back.
-        c->proc = 0;
-        found_runnable = 1;
+    if((p = runqpop()) == 0){
+      // nothing to run: go tickless, waking only for
+      // interrupts and one-shot timers.  an interrupt
+      // handled since runqpop() may have woken a
+      // process, and without a tick nothing would get
+      // us out of wfi to run it, so look again with
+      // interrupts off.  wfi still wakes for interrupts
+      // that arrive after intr_off().
+      intr_off();
+      c->idle = 1;
+      // pairs with the fence in enqueue(): a CPU queueing
+      // a process here after runqempty() sees idle and
+      // sends an IPI, which ends the wfi.
+      __sync_synchronize();
+      timerset();
+      if(runqempty()){
+        t0 = r_time();
+        asm volatile("wfi");
+        statadd(ST_IDLE, r_time() - t0);
       }
-      release(&p->lock);
+      continue;
     }
 
-    if (found_runnable == 0) {
-      intr_on();
-      asm volatile("wfi");
+    acquire(&p->lock);
+    if(p->state != RUNNABLE)
+      panic("scheduler");
+    if(c->idle){
+      // restart the periodic tick.
+      c->idle = 0;
+      c->nexttick = r_time() + TICKINTERVAL;
+      timerset();
     }
+
+    // Switch to chosen process.  It is the process's job
+    // to release its lock and then reacquire it
+    // before jumping back to us.
+    p->state = RUNNING;
+    p->runstart = r_time();
+    p->resched = 0;
+    c->proc = p;
+    swtch(&c->context, &p->context);
+
+    // Process is done running for now.
+    // It should have changed its p->state before coming back.
+    // If it yielded, it goes back on a run queue, now that
+    // it has been charged for the run.
+    schedcharge(p);
+    c->proc = 0;
+    if(p->state == RUNNABLE)
+      runqadd(p);
+    release(&p->lock);
   }
 }
 
@@ -500,12 +932,14 @@ sched(void)
   if(intr_get())
     panic("sched interruptible");
 
+  statinc(ST_CSWITCH);
   intena = mycpu()->intena;
   swtch(&p->context, &mycpu()->context);
   mycpu()->intena = intena;
 }
 
 // Give up the CPU for one scheduling round.
+// scheduler() puts p back on the run queue.
 void
 yield(void)
 {
@@ -572,18 +1006,30 @@ sleep(void *chan, struct spinlock *lk)
 // Must be called without any p->lock.
 void
 wakeup(void *chan)
+{
+  wakeupn(chan, NPROC);
+}
+
+// Wake up at most n processes sleeping on chan,
+// and return how many were woken.
+// Must be called without any p->lock.
+int
+wakeupn(void *chan, int n)
 {
   struct proc *p;
+  int woken = 0;
 
-  for(p = proc; p < &proc[NPROC]; p++) {
+  for(p = proc; p < &proc[NPROC] && woken < n; p++) {
     if(p != myproc()){
       acquire(&p->lock);
       if(p->state == SLEEPING && p->chan == chan) {
-        p->state = RUNNABLE;
+        setrunnable(p);
+        woken++;
       }
       release(&p->lock);
     }
   }
+  return woken;
 }
 
 // Kill the process with the given pid.
@@ -600,7 +1046,40 @@ kill(int pid)
       p->killed = 1;
       if(p->state == SLEEPING){
         // Wake process from sleep().
-        p->state = RUNNABLE;
+        setrunnable(p);
+      }
+      release(&p->lock);
+      return 0;
+    }
+    release(&p->lock);
+  }
+  return -1;
+}
+
+// Restrict the process with the given pid (0 for the
+// caller) to the CPUs in mask, 1 << cpuid.  Fails if
+// none of them is running.
+int
+setaffinity(int pid, uint mask)
+{
+  struct proc *p;
+
+  if((mask & cpusonline()) == 0)
+    return -1;
+  if(pid == 0)
+    pid = myproc()->pid;
+  for(p = proc; p < &proc[NPROC]; p++){
+    acquire(&p->lock);
+    if(p->pid == pid && p->state != UNUSED){
+      p->affinity = mask;
+      if((mask & (1 << p->cpu)) == 0){
+        // move it now if it is waiting in a run queue,
+        // or at its next trap if it is running, which
+        // an IPI brings forward.
+        if(p->state != RUNNABLE || runqrequeue(p) == 0)
+          p->resched = 1;
+        if(p->state == RUNNING && p->cpu != cpuid())
+          ipi(p->cpu, IPI_WAKE);
       }
       release(&p->lock);
       return 0;
@@ -610,6 +1089,28 @@ kill(int pid)
   return -1;
 }
 
+// The CPU mask of the process with the given pid
+// (0 for the caller), or -1.
+int
+getaffinity(int pid)
+{
+  struct proc *p;
+  int mask;
+
+  if(pid == 0)
+    pid = myproc()->pid;
+  for(p = proc; p < &proc[NPROC]; p++){
+    acquire(&p->lock);
+    if(p->pid == pid && p->state != UNUSED){
+      mask = p->affinity & ((1 << NCPU) - 1);
+      release(&p->lock);
+      return mask;
+    }
+    release(&p->lock);
+  }
+  return -1;
+}
+
 void
 setkilled(struct proc *p)
 {
@@ -24,8 +24,19 @@ struct cpu {
   struct context context;     // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
+  uint64 nexttick;            // time of next scheduler tick.
+  int idle;                   // Nothing to run; periodic tick off.
+  uint64 asidgen;             // ASID generation the TLB is clean for.
+  uint64 nextbalance;         // time of next run queue balancing.
+  int ipi;                    // IPI_* reasons for a pending IPI.
+  uint tlbreq;                // TLB flushes asked of this CPU.
+  uint tlbdone;               // tlbreq as of its last IPI_TLB flush.
 };
 
+// reasons for an inter-processor interrupt.
+#define IPI_WAKE  0x1         // look at the run queue, or p->resched
+#define IPI_TLB   0x2         // flush the TLB
+
 extern struct cpu cpus[NCPU];
 
 // per-process data for the trap handling code in trampoline.S.
@@ -81,7 +92,61 @@ struct trapframe {
 
 enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
-// Per-process state
+// a cached user translation, for copyin() and copyout().
+#define NUTLB 4
+struct utlb {
+  uint64 va;  // page-aligned user virtual address
+  pte_t pte;  // its leaf PTE, or 0 if the entry is empty
+};
+
+// a mmap()ed area of a file; see mmap.c.
+struct vma {
+  uint64 addr;     // page-aligned
+  uint64 len;      // bytes, a multiple of PGSIZE
+  int prot;        // PROT_READ, PROT_WRITE
+  int flags;       // MAP_SHARED or MAP_PRIVATE
+  uint off;        // file offset of addr
+  struct file *f;  // 0 if this slot is free
+};
+
+// A user address space, shared by the threads of a process.
+struct mm {
+  struct spinlock lock;        // protects ref and tfslots
+  int ref;                     // threads using it, zombies included
+  uint tfslots;                // trapframe slots in use, 1 << slot
+  struct sleeplock vmlock;     // serializes changes to pagetable and vma
+
+  pagetable_t pagetable;       // User page table
+  uint64 sz;                   // Size of process memory (bytes)
+  struct vma vma[NVMA];        // mmap()ed files
+  struct usyscall *usyscall;   // read-only page for the user, at USYSCALL
+  uint64 asid;                 // address-space ID, if asidgen is current
+  uint64 asidgen;              // generation asid belongs to; 0 if none
+  uint64 tlbstale;             // harts that may hold stale TLB entries
+  uint64 utlbgen;              // bumped to empty every thread's utlb
+};
+
+// Open files and current directory, shared by the threads
+// of a process.  lock is taken before ftable.lock and
+// itable.lock, by filedup() and idup().
+struct files {
+  struct spinlock lock;        // protects ref, ofile and cwd
+  int ref;                     // threads using it
+  struct file *ofile[NOFILE];  // Open files
+  struct inode *cwd;           // Current directory
+};
+
+// Pages unmapped from an address space that other threads
+// may be using on other harts, kept until every such hart
+// has flushed its TLB; see pagebatchadd().
+#define NBATCH 32
+struct pagebatch {
+  struct proc *p;              // whose address space; 0 frees at once
+  int n;
+  uint64 pa[NBATCH];           // low bit set for a megapage
+};
+
+// Per-process state; one per thread.
 struct proc {
   struct spinlock lock;
 
@@ -91,17 +156,30 @@ struct proc {
   int killed;                  // If non-zero, have been killed
   int xstate;                  // Exit status to be returned to parent's wait
   int pid;                     // Process ID
+  int nice;                    // -20 (most CPU) to 19 (least)
+  uint64 vruntime;             // weighted run time, in time CSR units
+  uint64 runstart;             // when it last started running
+  uint affinity;               // CPUs it may run on, 1 << cpuid
+  int cpu;                     // CPU whose run queue it is on or last used
+  int rqidx;                   // index in that run queue, or -1
 
   // wait_lock must be held when using this:
   struct proc *parent;         // Parent process
 
   // these are private to the process, so p->lock need not be held.
   uint64 kstack;               // Virtual address of kernel stack
-  uint64 sz;                   // Size of process memory (bytes)
-  pagetable_t pagetable;       // User page table
+  struct mm *mm;               // Address space, maybe shared
+  pagetable_t pagetable;       // User page table, mm->pagetable
+  struct utlb utlb[NUTLB];     // recent translations of pagetable
+  uint64 utlbgen;              // mm->utlbgen when utlb was last emptied
+  int isthread;                // created by clone(), not fork()
+  int tfslot;                  // trapframe is mapped at TFSLOT(tfslot)
   struct trapframe *trapframe; // data page for trampoline.S
   struct context context;      // swtch() here to run process
-  struct file *ofile[NOFILE];  // Open files
-  struct inode *cwd;           // Current directory
+  struct files *files;         // Open files and cwd, maybe shared
   char name[16];               // Process name (debugging)
+  uint64 tracemask;            // system calls to trace (1 << SYS_x)
+  int pollseq;                 // bumped by pollwake(), under timerlock
+  int ilocks;                  // inode locks held; see vmafault()
+  int resched;                 // a woken process should run instead
 };
@@ -0,0 +1,122 @@
+// Sampling profiler.
+//
+// While profiling is on, every timer interrupt records the
+// interrupted pc and process in its CPU's ring of samples.
+// Each ring has one producer (its CPU's timer interrupt) and
+// is drained by profread(), so the producer needs no lock:
+// it fills a slot and then advances head, and drops the
+// sample if the ring is full.
+
+#include "types.h"
+#include "param.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "proc.h"
+#include "stats.h"
+#include "defs.h"
+
+struct profring {
+  uint head;                 // next slot to fill; only the producer writes
+  uint tail;                 // next slot to drain; only profread() writes
+  struct profsample s[NPROFSAMPLE];
+} __attribute__((aligned(64)));
+
+static struct profring rings[NCPU];
+static struct spinlock proflock;  // serializes profread() and profctl()
+static int profiling;
+static uint dropped;
+
+void
+profinit(void)
+{
+  initlock(&proflock, "prof");
+}
+
+// Called from devintr() on each timer interrupt, with
+// interrupts off, while sepc and sstatus still describe
+// the interrupted code.
+void
+profsample(void)
+{
+  struct profring *r;
+  struct profsample *s;
+  struct proc *p;
+  uint head;
+
+  if(!__atomic_load_n(&profiling, __ATOMIC_RELAXED))
+    return;
+
+  r = &rings[cpuid()];
+  head = r->head;
+  if(head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) == NPROFSAMPLE){
+    __atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+    return;
+  }
+  s = &r->s[head % NPROFSAMPLE];
+  s->pc = r_sepc();
+  s->cpu = cpuid();
+  s->user = (r_sstatus() & SSTATUS_SPP) == 0;
+  p = myproc();
+  if(p){
+    // p->pid and p->name only change while p is not running
+    // here, so they are safe to read without p->lock.
+    s->pid = p->pid;
+    safestrcpy(s->name, p->name, sizeof(s->name));
+  } else {
+    s->pid = 0;
+    s->name[0] = 0;
+  }
+  __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+}
+
+// Turn profiling on (discarding old samples) or off.
+// Returns the number of samples dropped because a ring was
+// full since profiling was last turned on.
+int
+profctl(int on)
+{
+  int c, n;
+
+  acquire(&proflock);
+  if(on){
+    for(c = 0; c < NCPU; c++)
+      __atomic_store_n(&rings[c].tail, __atomic_load_n(&rings[c].head, __ATOMIC_ACQUIRE),
+                       __ATOMIC_RELEASE);
+    __atomic_store_n(&dropped, 0, __ATOMIC_RELAXED);
+  }
+  __atomic_store_n(&profiling, on != 0, __ATOMIC_RELAXED);
+  n = __atomic_load_n(&dropped, __ATOMIC_RELAXED);
+  release(&proflock);
+  return n;
+}
+
+// Move up to n samples, oldest first per CPU, to the user
+// address dst.  Returns the number moved, or -1 on a bad
+// address.
+int
+profread(uint64 dst, int n)
+{
+  struct profring *r;
+  int c, i;
+  uint tail;
+
+  acquire(&proflock);
+  i = 0;
+  for(c = 0; c < NCPU && i < n; c++){
+    r = &rings[c];
+    for(tail = r->tail; i < n && tail != __atomic_load_n(&r->head, __ATOMIC_ACQUIRE); tail++, i++){
+      if(copyout(myproc()->pagetable, dst + i*sizeof(struct profsample),
+                 (char*)&r->s[tail % NPROFSAMPLE], sizeof(struct profsample)) < 0){
+        i = -1;
+        break;
+      }
+    }
+    // let the producer reuse the drained slots.
+    __atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+    if(i < 0)
+      break;
+  }
+  release(&proflock);
+  return i;
+}
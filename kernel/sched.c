@@ -0,0 +1,421 @@
+// Weighted fair scheduling.
+//
+// Each process accumulates virtual run time: the time it has
+// spent running, scaled by NICE0 over the weight of its nice
+// value.  Each step of nice is worth about 1.25x in weight, so
+// a process at nice 0 gets about ten times the CPU of one at
+// nice 10.  Each CPU runs the RUNNABLE process with the least
+// vruntime from its own run queue, a min-heap, so the processes
+// sharing a CPU get it in proportion to their weights.
+//
+// A process that wakes from sleep() is put no further behind
+// the run queue's least vruntime than WAKEBONUS: one that
+// mostly sleeps, like an interactive shell, runs ahead of the
+// CPU-bound ones when it wakes, but cannot save up credit
+// during a long sleep.  If it is ahead of the process that
+// woke it by more than WAKEGRAN, that process gives up the CPU
+// at its next trap rather than at the end of its tick.  New
+// processes start level with the least vruntime.
+//
+// A process goes back on the queue of the CPU it last ran on,
+// whose cache is warm, unless its affinity mask forbids that
+// CPU or that CPU's load (queued plus running processes) is
+// IMBALANCE or more above the least-loaded CPU it may use.
+// Every BALANCEINTERVAL, and whenever it runs out of work, a
+// CPU also pulls processes from the busiest CPU if their loads
+// differ by IMBALANCE or more.
+//
+// So fairness is per CPU.  Weights divide a CPU among the
+// processes on its queue, but placement and balancing count
+// processes, not weight: two nice 0 processes may share one
+// CPU while two nice 10 ones share another, and each pair
+// splits its CPU evenly.  Pin processes with setaffinity() to
+// compare their weights.
+//
+// A CPU with nothing to run sleeps in wfi with its tick off,
+// so queueing a process on another CPU that is idle sends it
+// an IPI to look at its queue; a wakeup that should preempt
+// another CPU's process sends one too.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "proc.h"
+#include "stats.h"
+#include "defs.h"
+
+#define NICE0     1024                // weight of nice 0
+#define WAKEBONUS TICKINTERVAL        // most credit a waking process gets
+#define WAKEGRAN  (TIMEBASE / 1000)   // least lead for a wakeup to preempt
+#define IMBALANCE 2                   // load difference worth a migration
+#define BALANCEINTERVAL TICKINTERVAL
+
+// weights for nice -20 .. 19, from Linux.
+static const int niceweight[40] = {
+  88761, 71755, 56483, 46273, 36291,
+  29154, 23254, 18705, 14949, 11916,
+   9548,  7620,  6100,  4904,  3906,
+   3121,  2501,  1991,  1586,  1277,
+   1024,   820,   655,   526,   423,
+    335,   272,   215,   172,   137,
+    110,    87,    70,    56,    45,
+     36,    29,    23,    18,    15,
+};
+
+// One CPU's RUNNABLE processes, as a min-heap on vruntime.
+// A queued process's vruntime, cpu and rqidx are protected
+// by the lock of the queue it is on.
+struct runq {
+  struct spinlock lock;
+  struct proc *heap[NPROC];
+  int n;
+  uint64 minvruntime;   // vruntime of the last process run; never decreases
+} __attribute__((aligned(64)));
+
+static struct runq runqs[NCPU];
+static uint online;     // CPUs that have started scheduling, 1 << cpuid
+
+void
+schedinit(void)
+{
+  int i;
+
+  for(i = 0; i < NCPU; i++)
+    initlock(&runqs[i].lock, "runq");
+}
+
+// Called by each CPU as it starts scheduling.
+void
+schedonline(void)
+{
+  __atomic_fetch_or(&online, 1 << cpuid(), __ATOMIC_RELAXED);
+}
+
+// CPUs that are scheduling.
+uint
+cpusonline(void)
+{
+  return __atomic_load_n(&online, __ATOMIC_RELAXED);
+}
+
+static void
+heapswap(struct runq *rq, int i, int j)
+{
+  struct proc *t = rq->heap[i];
+  rq->heap[i] = rq->heap[j];
+  rq->heap[j] = t;
+  rq->heap[i]->rqidx = i;
+  rq->heap[j]->rqidx = j;
+}
+
+static void
+siftup(struct runq *rq, int i)
+{
+  while(i > 0 && rq->heap[(i-1)/2]->vruntime > rq->heap[i]->vruntime){
+    heapswap(rq, i, (i-1)/2);
+    i = (i-1)/2;
+  }
+}
+
+static void
+siftdown(struct runq *rq, int i)
+{
+  int c;
+
+  for(; (c = 2*i + 1) < rq->n; i = c){
+    if(c+1 < rq->n && rq->heap[c+1]->vruntime < rq->heap[c]->vruntime)
+      c++;
+    if(rq->heap[i]->vruntime <= rq->heap[c]->vruntime)
+      break;
+    heapswap(rq, i, c);
+  }
+}
+
+static void
+heapadd(struct runq *rq, struct proc *p)
+{
+  p->rqidx = rq->n++;
+  rq->heap[p->rqidx] = p;
+  siftup(rq, p->rqidx);
+}
+
+// Take heap[i] off rq and return it.
+static struct proc*
+heapdel(struct runq *rq, int i)
+{
+  struct proc *p = rq->heap[i], *last;
+
+  rq->n--;
+  if(i < rq->n){
+    last = rq->heap[rq->n];
+    rq->heap[i] = last;
+    last->rqidx = i;
+    siftup(rq, i);
+    siftdown(rq, last->rqidx);
+  }
+  p->rqidx = -1;
+  return p;
+}
+
+// Queued plus running processes on a CPU.  A hint, without locks.
+static int
+load(int cpu)
+{
+  return __atomic_load_n(&runqs[cpu].n, __ATOMIC_RELAXED) +
+    (__atomic_load_n(&cpus[cpu].proc, __ATOMIC_RELAXED) != 0);
+}
+
+// Move p's vruntime from its queue's scale to cpu's.
+static void
+rebase(struct proc *p, int cpu)
+{
+  uint64 from = runqs[p->cpu].minvruntime;
+  uint64 to = runqs[cpu].minvruntime;
+
+  if(p->vruntime + to >= from)
+    p->vruntime = p->vruntime + to - from;
+  else
+    p->vruntime = 0;
+  p->cpu = cpu;
+  statinc(ST_MIGRATE);
+}
+
+// Choose the queue for p.  Caller holds p->lock.
+static int
+pickcpu(struct proc *p)
+{
+  uint ok;
+  int i, best;
+
+  ok = p->affinity & cpusonline();
+  if(ok == 0)
+    return p->cpu;    // during boot, before scheduler() starts
+  best = -1;
+  for(i = 0; i < NCPU; i++)
+    if((ok & (1 << i)) && (best < 0 || load(i) < load(best)))
+      best = i;
+  if((ok & (1 << p->cpu)) && load(p->cpu) - load(best) < IMBALANCE)
+    return p->cpu;
+  return best;
+}
+
+enum { REQUEUE, WAKE, NEW };
+
+// Put RUNNABLE p on a queue.  A process that is WAKE from
+// sleep or NEW gets a fair start on that queue's scale.
+// Returns the CPU.  Caller holds p->lock.
+static int
+enqueue(struct proc *p, int how)
+{
+  struct runq *rq;
+  int cpu;
+
+  cpu = pickcpu(p);
+  rq = &runqs[cpu];
+  acquire(&rq->lock);
+  if(cpu != p->cpu)
+    rebase(p, cpu);
+  if(how == WAKE && p->vruntime + WAKEBONUS < rq->minvruntime)
+    p->vruntime = rq->minvruntime - WAKEBONUS;
+  else if(how == NEW && p->vruntime < rq->minvruntime)
+    p->vruntime = rq->minvruntime;
+  heapadd(rq, p);
+  release(&rq->lock);
+
+  // pairs with the fence in scheduler(): either it sees
+  // our process in its queue, or we see that it is idle.
+  if(cpu != cpuid()){
+    __sync_synchronize();
+    if(__atomic_load_n(&cpus[cpu].idle, __ATOMIC_RELAXED))
+      ipi(cpu, IPI_WAKE);
+  }
+  return cpu;
+}
+
+// Put p, which has just stopped running and is still
+// RUNNABLE, back on a run queue.  Caller holds p->lock.
+void
+runqadd(struct proc *p)
+{
+  enqueue(p, REQUEUE);
+}
+
+// Take a RUNNABLE p that is waiting on a run queue off it
+// and queue it again, after a change of affinity.  Returns
+// 0 if p was already taken off by a scheduler about to run
+// it.  Caller holds p->lock.
+int
+runqrequeue(struct proc *p)
+{
+  struct runq *rq;
+  int cpu;
+
+  for(;;){
+    cpu = __atomic_load_n(&p->cpu, __ATOMIC_RELAXED);
+    rq = &runqs[cpu];
+    acquire(&rq->lock);
+    if(p->cpu == cpu)
+      break;
+    release(&rq->lock);   // a balancer moved it
+  }
+  if(p->rqidx < 0){
+    release(&rq->lock);
+    return 0;
+  }
+  heapdel(rq, p->rqidx);
+  release(&rq->lock);
+  enqueue(p, REQUEUE);
+  return 1;
+}
+
+// Pull processes to this CPU from the busiest one, if that
+// one's load exceeds ours by IMBALANCE or more: half the
+// difference, taking only those allowed to run here, and
+// the least urgent first, from the end of the heap.
+static void
+balance(void)
+{
+  struct runq *from, *to, *first, *second;
+  struct proc *p;
+  int me, i, busiest, n;
+
+  me = cpuid();
+  busiest = -1;
+  for(i = 0; i < NCPU; i++)
+    if(i != me && (cpusonline() & (1 << i)) &&
+       (busiest < 0 || load(i) > load(busiest)))
+      busiest = i;
+  if(busiest < 0 || (n = load(busiest) - load(me)) < IMBALANCE)
+    return;
+  n /= 2;
+
+  from = &runqs[busiest];
+  to = &runqs[me];
+  first = busiest < me ? from : to;
+  second = busiest < me ? to : from;
+  acquire(&first->lock);
+  acquire(&second->lock);
+  for(i = from->n - 1; i >= 0 && n > 0; i--){
+    p = from->heap[i];
+    if((p->affinity & (1 << me)) == 0)
+      continue;
+    heapdel(from, i);
+    rebase(p, me);
+    heapadd(to, p);
+    n--;
+  }
+  release(&second->lock);
+  release(&first->lock);
+}
+
+// Take the process with the least vruntime off this CPU's
+// run queue, balancing first if it is time or if the queue
+// is empty.  Returns 0 if there is nothing to run.  The
+// caller must then acquire its lock; it stays RUNNABLE,
+// since only the scheduler changes a RUNNABLE process.
+// Called by scheduler().
+struct proc*
+runqpop(void)
+{
+  struct cpu *c = mycpu();
+  struct runq *rq = &runqs[cpuid()];
+  struct proc *p;
+
+  if(rq->n == 0 || r_time() >= c->nextbalance){
+    balance();
+    c->nextbalance = r_time() + BALANCEINTERVAL;
+  }
+
+  acquire(&rq->lock);
+  if(rq->n == 0){
+    release(&rq->lock);
+    return 0;
+  }
+  p = heapdel(rq, 0);
+  if(p->vruntime > rq->minvruntime)
+    rq->minvruntime = p->vruntime;
+  release(&rq->lock);
+  return p;
+}
+
+// Is this CPU's run queue empty?  A hint, without the lock.
+// Called by scheduler().
+int
+runqempty(void)
+{
+  return __atomic_load_n(&runqs[cpuid()].n, __ATOMIC_RELAXED) == 0;
+}
+
+// vruntime for running dt time CSR units at p's nice.
+static uint64
+vtime(struct proc *p, uint64 dt)
+{
+  return dt * NICE0 / niceweight[p->nice + 20];
+}
+
+// Charge p for having run since p->runstart.
+// Caller holds p->lock.
+void
+schedcharge(struct proc *p)
+{
+  uint64 dt = r_time() - p->runstart;
+
+  p->vruntime += vtime(p, dt);
+  statadd(ST_BUSY, dt);
+}
+
+// Make a new or sleeping p RUNNABLE and queue it.
+// Caller holds p->lock.
+void
+setrunnable(struct proc *p)
+{
+  struct proc *cur;
+  uint64 v;
+  int cpu, wake;
+
+  wake = p->state == SLEEPING;
+  p->state = RUNNABLE;
+  cpu = enqueue(p, wake ? WAKE : NEW);
+
+  // preempt the process running on p's CPU if p is well
+  // ahead.  cur's vruntime and runstart change only while
+  // cur is not running.  on another CPU, cur is a hint that
+  // may have stopped running already; a stray resched costs
+  // at most an early yield.
+  if(!wake)
+    return;
+  if(cpu == cpuid())
+    cur = myproc();
+  else
+    cur = __atomic_load_n(&cpus[cpu].proc, __ATOMIC_RELAXED);
+  if(cur == 0 || cur == p)
+    return;
+  v = cur->vruntime + vtime(cur, r_time() - cur->runstart);
+  if(p->vruntime + WAKEGRAN < v){
+    cur->resched = 1;
+    if(cpu != cpuid())
+      ipi(cpu, IPI_WAKE);
+  }
+}
+
+// Add incr to the calling process's nice value, within
+// -20 to 19, and return the new value.
+int
+nice(int incr)
+{
+  struct proc *p = myproc();
+  int n;
+
+  acquire(&p->lock);
+  n = p->nice + incr;
+  if(n < -20)
+    n = -20;
+  if(n > 19)
+    n = 19;
+  p->nice = n;
+  release(&p->lock);
+  return n;
+}
@@ -0,0 +1,125 @@
+// Shared-memory segments.
+//
+// shmget(key, npages) returns a file descriptor for a segment
+// of npages zeroed pages, and mmap(0, len, prot, MAP_SHARED,
+// fd, off) maps them (see vmafault() in mmap.c).  Processes
+// that map the same segment map the same physical pages, so
+// data passes between them with no copies at all.
+//
+// Key 0 makes an anonymous segment, reached only through its
+// descriptor (inherited by fork(), say); other keys name a
+// segment, and shmget() with the same key attaches to it.  A
+// segment, and its name, last while a file refers to it,
+// including the files held by its mappings.  Its pages are
+// reference counted, and last while they are mapped.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "defs.h"
+
+struct shm {
+  int ref;                 // files referring to it; 0 if free
+  int key;                 // 0 if anonymous
+  int npages;
+  char *pages[NSHMPAGE];
+};
+
+struct {
+  struct spinlock lock;
+  struct shm shm[NSHM];
+} shmtable;
+
+void
+shminit(void)
+{
+  initlock(&shmtable.lock, "shm");
+}
+
+// Return the segment named key, or a new one of npages
+// pages if key is 0 or names none, with a new reference.
+// Returns 0 if the existing segment is smaller than npages,
+// or there is no room.
+struct shm*
+shmget(int key, int npages)
+{
+  struct shm *s, *empty = 0;
+  int i;
+
+  if(npages <= 0 || npages > NSHMPAGE)
+    return 0;
+
+  acquire(&shmtable.lock);
+  for(s = shmtable.shm; s < &shmtable.shm[NSHM]; s++){
+    if(s->ref == 0){
+      if(empty == 0)
+        empty = s;
+    } else if(key != 0 && s->key == key){
+      if(npages > s->npages){
+        release(&shmtable.lock);
+        return 0;
+      }
+      s->ref++;
+      release(&shmtable.lock);
+      return s;
+    }
+  }
+  if((s = empty) == 0){
+    release(&shmtable.lock);
+    return 0;
+  }
+  for(i = 0; i < npages; i++){
+    if((s->pages[i] = kalloc()) == 0){
+      while(--i >= 0)
+        kfree(s->pages[i]);
+      release(&shmtable.lock);
+      return 0;
+    }
+    memset(s->pages[i], 0, PGSIZE);
+  }
+  s->ref = 1;
+  s->key = key;
+  s->npages = npages;
+  release(&shmtable.lock);
+  return s;
+}
+
+// Drop a reference to s.  The last one frees the segment,
+// and its name; mapped pages live on until unmapped.
+void
+shmclose(struct shm *s)
+{
+  int i;
+
+  acquire(&shmtable.lock);
+  if(--s->ref == 0){
+    for(i = 0; i < s->npages; i++)
+      kfree(s->pages[i]);
+    s->key = 0;
+    s->npages = 0;
+  }
+  release(&shmtable.lock);
+}
+
+// Size of s in bytes.
+uint64
+shmsize(struct shm *s)
+{
+  return (uint64)s->npages * PGSIZE;
+}
+
+// The page of s at byte offset off, with a new reference
+// for the caller to map, or 0 if off is past the end.
+void*
+shmpage(struct shm *s, uint64 off)
+{
+  char *pa;
+
+  if(off >= shmsize(s))
+    return 0;
+  pa = s->pages[off / PGSIZE];
+  kdup(pa);
+  return pa;
+}
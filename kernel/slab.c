@@ -0,0 +1,207 @@
+// Slab allocator for small kernel objects.
+//
+// A cache carves whole pages from kalloc() into objects of a
+// single size.  Each page (a slab) starts with a struct slab
+// that keeps a list of its free objects, so the slab owning an
+// object is found by rounding the object's address down to a
+// page boundary.
+//
+// Each CPU keeps a small magazine of recently freed objects.
+// Most slaballoc() and slabfree() calls touch only the
+// current CPU's magazine, with interrupts off, and never
+// take the cache's lock.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "riscv.h"
+#include "slab.h"
+#include "defs.h"
+
+struct slab {
+  struct slabcache *cache;
+  struct slab *next;     // on cache->partial
+  struct slab *prev;
+  void *freelist;        // free objects in this slab
+  uint inuse;            // objects handed out (incl. magazines)
+};
+
+struct freeobj {
+  struct freeobj *next;
+};
+
+#define SLABHDR ((sizeof(struct slab) + 15) & ~15)
+
+static struct slab*
+objslab(void *obj)
+{
+  return (struct slab*)PGROUNDDOWN((uint64)obj);
+}
+
+static void
+unlink_partial(struct slabcache *c, struct slab *s)
+{
+  if(s->prev)
+    s->prev->next = s->next;
+  else
+    c->partial = s->next;
+  if(s->next)
+    s->next->prev = s->prev;
+  s->next = s->prev = 0;
+}
+
+static void
+link_partial(struct slabcache *c, struct slab *s)
+{
+  s->prev = 0;
+  s->next = c->partial;
+  if(c->partial)
+    c->partial->prev = s;
+  c->partial = s;
+}
+
+// Add a fresh slab to cache c.
+// Caller must hold c->lock.
+static int
+growcache(struct slabcache *c)
+{
+  struct slab *s;
+  char *p;
+  int i;
+
+  if((s = (struct slab*)kalloc()) == 0)
+    return -1;
+  s->cache = c;
+  s->freelist = 0;
+  s->inuse = 0;
+  p = (char*)s + SLABHDR;
+  for(i = 0; i < c->perslab; i++, p += c->size){
+    ((struct freeobj*)p)->next = s->freelist;
+    s->freelist = p;
+  }
+  link_partial(c, s);
+  c->nslab++;
+  c->nempty++;
+  return 0;
+}
+
+// Take one object from the slabs of cache c.
+// Caller must hold c->lock.
+static void*
+getobj(struct slabcache *c)
+{
+  struct slab *s;
+  struct freeobj *o;
+
+  if(c->partial == 0 && growcache(c) < 0)
+    return 0;
+  s = c->partial;
+  o = s->freelist;
+  s->freelist = o->next;
+  if(s->inuse++ == 0)
+    c->nempty--;
+  if(s->freelist == 0)
+    unlink_partial(c, s);
+  return o;
+}
+
+// Return one object to its slab.
+// Caller must hold c->lock.
+static void
+putobj(struct slabcache *c, void *obj)
+{
+  struct slab *s = objslab(obj);
+  struct freeobj *o = obj;
+
+  if(s->cache != c)
+    panic("slabfree: wrong cache");
+  if(s->freelist == 0)
+    link_partial(c, s);
+  o->next = s->freelist;
+  s->freelist = o;
+  if(--s->inuse > 0)
+    return;
+
+  // s is now empty.  Keep one empty slab around to
+  // absorb alloc/free churn, and never drop below
+  // the reserve; give the rest back to kalloc().
+  if(c->nempty == 0 || (c->nslab - 1) * c->perslab < c->reserve){
+    c->nempty++;
+    return;
+  }
+  unlink_partial(c, s);
+  c->nslab--;
+  kfree((void*)s);
+}
+
+// Set up cache c for objects of the given size,
+// and preallocate slabs for reserve objects.
+void
+slabinit(struct slabcache *c, char *name, uint size, uint reserve)
+{
+  initlock(&c->lock, name);
+  c->name = name;
+  c->size = (size + 15) & ~15;
+  if(c->size < sizeof(struct freeobj) || c->size > PGSIZE - SLABHDR)
+    panic("slabinit: size");
+  c->perslab = (PGSIZE - SLABHDR) / c->size;
+  c->reserve = reserve;
+  c->partial = 0;
+  c->nslab = 0;
+  c->nempty = 0;
+  for(int i = 0; i < NCPU; i++)
+    c->mag[i].n = 0;
+
+  acquire(&c->lock);
+  while(c->nslab * c->perslab < reserve){
+    if(growcache(c) < 0)
+      panic("slabinit: out of memory");
+  }
+  release(&c->lock);
+}
+
+// Allocate one object from cache c.
+// Returns 0 if out of memory.  The contents
+// of the object are undefined.
+void*
+slaballoc(struct slabcache *c)
+{
+  struct magazine *m;
+  void *obj;
+
+  push_off();
+  m = &c->mag[cpuid()];
+  if(m->n == 0){
+    // refill half the magazine while we have the lock.
+    acquire(&c->lock);
+    while(m->n < MAGSIZE/2 && (obj = getobj(c)) != 0)
+      m->obj[m->n++] = obj;
+    release(&c->lock);
+  }
+  obj = 0;
+  if(m->n > 0)
+    obj = m->obj[--m->n];
+  pop_off();
+  return obj;
+}
+
+// Free an object previously returned by
+// slaballoc(c).
+void
+slabfree(struct slabcache *c, void *obj)
+{
+  struct magazine *m;
+
+  push_off();
+  m = &c->mag[cpuid()];
+  if(m->n == MAGSIZE){
+    // flush half the magazine back to the slabs.
+    acquire(&c->lock);
+    while(m->n > MAGSIZE/2)
+      putobj(c, m->obj[--m->n]);
+    release(&c->lock);
+  }
+  m->obj[m->n++] = obj;
+  pop_off();
+}
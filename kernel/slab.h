@@ -0,0 +1,22 @@
+// Caches of small, fixed-size kernel objects.
+// See slab.c.
+
+#define MAGSIZE 8  // objects kept in each per-CPU magazine
+
+// A CPU's stash of recently freed objects.
+struct magazine {
+  int n;
+  void *obj[MAGSIZE];
+};
+
+struct slabcache {
+  struct spinlock lock;
+  char *name;
+  uint size;             // object size, rounded up for alignment
+  uint perslab;          // objects per slab page
+  uint reserve;          // never shrink below this many objects
+  struct slab *partial;  // slabs with free objects
+  int nslab;             // pages owned by this cache
+  int nempty;            // slabs on partial with no objects in use
+  struct magazine mag[NCPU];
+};
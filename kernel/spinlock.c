@@ -5,15 +5,85 @@
 #include "memlayout.h"
 #include "spinlock.h"
 #include "riscv.h"
+#include "sleeplock.h"
 #include "proc.h"
+#include "stats.h"
 #include "defs.h"
 
+#ifdef LOCKSTAT
+// Locks are profiled by class: all locks with the same name
+// (every proc's lock, say) share one class.  Each CPU counts
+// into its own row, with interrupts off, so no atomics are
+// needed; lockstatread() sums the rows.  Class 0 collects
+// locks whose names don't fit in the table.
+
+static char *classname[NLOCKCLASS] = { "other" };
+static int nclass = 1;
+static uint classlock;   // a bare flag: acquire() can't be used here
+
+static struct lockstat lockstats[NCPU][NLOCKCLASS];
+
+static int
+lockclass(char *name)
+{
+  int i;
+
+  while(__sync_lock_test_and_set(&classlock, 1) != 0)
+    ;
+  __sync_synchronize();
+  for(i = 1; i < nclass; i++)
+    if(strncmp(classname[i], name, sizeof(lockstats[0][0].name)) == 0)
+      break;
+  if(i == nclass){
+    if(nclass < NLOCKCLASS)
+      classname[nclass++] = name;
+    else
+      i = 0;
+  }
+  __sync_synchronize();
+  __sync_lock_release(&classlock);
+  return i;
+}
+
+// Fill in *out with the totals for lock class i.
+// Returns -1 if there is no such class.
+int
+lockstatread(int i, struct lockstat *out)
+{
+  struct lockstat *s;
+  int c;
+
+  if(i < 0 || i >= nclass)
+    return -1;
+  memset(out, 0, sizeof(*out));
+  safestrcpy(out->name, classname[i], sizeof(out->name));
+  for(c = 0; c < NCPU; c++){
+    s = &lockstats[c][i];
+    out->nacquire += s->nacquire;
+    out->ncontend += s->ncontend;
+    out->spin += s->spin;
+    out->hold += s->hold;
+    if(s->maxhold > out->maxhold)
+      out->maxhold = s->maxhold;
+  }
+  return 0;
+}
+#endif
+
 void
 initlock(struct spinlock *lk, char *name)
 {
   lk->name = name;
+#ifdef TICKETLOCK
+  lk->next = 0;
+  lk->owner = 0;
+#else
   lk->locked = 0;
+#endif
   lk->cpu = 0;
+#ifdef LOCKSTAT
+  lk->cls = lockclass(name);
+#endif
 }
 
 // Acquire the lock.
@@ -21,16 +91,31 @@ initlock(struct spinlock *lk, char *name)
 void
 acquire(struct spinlock *lk)
 {
+  uint64 spins = 0;
+
   push_off(); // disable interrupts to avoid deadlock.
   if(holding(lk))
     panic("acquire");
 
+#ifdef LOCKSTAT
+  uint64 t0 = r_time();
+#endif
+
+#ifdef TICKETLOCK
+  // Take a ticket (amoadd.w) and wait for it to be served.
+  // Waiters only read owner, so the line is shared until
+  // release() writes it.
+  uint ticket = __atomic_fetch_add(&lk->next, 1, __ATOMIC_RELAXED);
+  while(__atomic_load_n(&lk->owner, __ATOMIC_RELAXED) != ticket)
+    spins++;
+#else
   // On RISC-V, sync_lock_test_and_set turns into an atomic swap:
   //   a5 = 1
   //   s1 = &lk->locked
   //   amoswap.w.aq a5, a5, (s1)
   while(__sync_lock_test_and_set(&lk->locked, 1) != 0)
-    ;
+    spins++;
+#endif
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that the critical section's memory
@@ -40,6 +125,18 @@ acquire(struct spinlock *lk)
 
   // Record info about lock acquisition for holding() and debugging.
   lk->cpu = mycpu();
+  if(spins)
+    statadd(ST_LOCKSPIN, spins);
+
+#ifdef LOCKSTAT
+  struct lockstat *s = &lockstats[cpuid()][lk->cls];
+  lk->tacquire = r_time();
+  s->nacquire++;
+  if(spins){
+    s->ncontend++;
+    s->spin += lk->tacquire - t0;
+  }
+#endif
 }
 
 // Release the lock.
@@ -49,6 +146,14 @@ release(struct spinlock *lk)
   if(!holding(lk))
     panic("release");
 
+#ifdef LOCKSTAT
+  struct lockstat *s = &lockstats[cpuid()][lk->cls];
+  uint64 hold = r_time() - lk->tacquire;
+  s->hold += hold;
+  if(hold > s->maxhold)
+    s->maxhold = hold;
+#endif
+
   lk->cpu = 0;
 
   // Tell the C compiler and the CPU to not move loads or stores
@@ -59,6 +164,12 @@ release(struct spinlock *lk)
   // On RISC-V, this emits a fence instruction.
   __sync_synchronize();
 
+#ifdef TICKETLOCK
+  // Serve the next ticket.  Only the holder writes owner,
+  // so a plain increment is safe; the store must be a
+  // single instruction, hence the atomic store.
+  __atomic_store_n(&lk->owner, lk->owner + 1, __ATOMIC_RELAXED);
+#else
   // Release the lock, equivalent to lk->locked = 0.
   // This code doesn't use a C assignment, since the C standard
   // implies that an assignment might be implemented with
@@ -67,6 +178,7 @@ release(struct spinlock *lk)
   //   s1 = &lk->locked
   //   amoswap.w zero, zero, (s1)
   __sync_lock_release(&lk->locked);
+#endif
 
   pop_off();
 }
@@ -77,7 +189,11 @@ int
 holding(struct spinlock *lk)
 {
   int r;
+#ifdef TICKETLOCK
+  r = (lk->owner != lk->next && lk->cpu == mycpu());
+#else
   r = (lk->locked && lk->cpu == mycpu());
+#endif
   return r;
 }
 
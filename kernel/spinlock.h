@@ -1,9 +1,21 @@
 // Mutual exclusion lock.
 struct spinlock {
+#ifdef TICKETLOCK
+  // Waiters take a ticket and are served in order,
+  // so no CPU can be starved by the others.
+  uint next;         // Next ticket to hand out.
+  uint owner;        // Ticket now holding the lock.
+#else
   uint locked;       // Is the lock held?
+#endif
 
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
+
+#ifdef LOCKSTAT
+  int cls;           // Index of name in the lock class table.
+  uint64 tacquire;   // time CSR when acquired.
+#endif
 };
 
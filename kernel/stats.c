@@ -0,0 +1,58 @@
+// Per-CPU event counters.
+//
+// Hot paths call statinc() to count events on the current
+// CPU's row, so CPUs never write the same cache line.
+// kstats() sums the rows, or reports a single CPU's.  The
+// rows live in the vdata pages, which every process also
+// sees read-only at VDATA.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "stats.h"
+#include "defs.h"
+
+struct vdata vdata = {
+  .timebase = TIMEBASE,
+  .hz = HZ,
+};
+
+_Static_assert(sizeof(struct vdata) <= NVDATA*PGSIZE, "NVDATA too small");
+
+// Add n to counter i.
+// May be called with interrupts enabled: if the process
+// moves to another CPU meanwhile, the atomic add still
+// lands safely, just on the old CPU's row.
+void
+statadd(int i, uint64 n)
+{
+  __atomic_fetch_add(&vdata.cpu[cpuid()].n[i], n, __ATOMIC_RELAXED);
+}
+
+void
+statinc(int i)
+{
+  statadd(i, 1);
+}
+
+// Fill in *ks with the counters of one CPU,
+// or with the sum over all CPUs if cpu is -1.
+// Returns -1 if cpu is out of range.
+int
+statread(int cpu, struct kstats *ks)
+{
+  int c, i;
+
+  if(cpu < -1 || cpu >= NCPU)
+    return -1;
+  memset(ks, 0, sizeof(*ks));
+  ks->time = r_time();
+  for(c = 0; c < NCPU; c++){
+    if(cpu != -1 && c != cpu)
+      continue;
+    for(i = 0; i < NSTAT; i++)
+      ks->n[i] += __atomic_load_n(&vdata.cpu[c].n[i], __ATOMIC_RELAXED);
+  }
+  return 0;
+}
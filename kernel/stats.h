@@ -0,0 +1,76 @@
+// Kernel event counters, read with the kstats() system call,
+// profiler samples, read with profread(), and system call
+// trace records, read with traceread().
+// Shared with user programs.
+
+#define MAXSYSCALL 64  // room for per-syscall counts
+
+enum {
+  ST_BHIT,       // bget() found the block cached
+  ST_BMISS,      // bget() recycled a buffer
+  ST_KALLOC,     // pages allocated
+  ST_KFREE,      // pages freed
+  ST_CSWITCH,    // sched() switches away from a process
+  ST_DISKRD,     // disk reads issued
+  ST_DISKWR,     // disk writes issued
+  ST_LOCKSPIN,   // acquire() spin iterations
+  ST_INTR,       // device and timer interrupts
+  ST_PCHIT,      // page cache hits, text and file pages
+  ST_PCMISS,     // page cache misses
+  ST_BUSY,       // time CSR units spent running processes
+  ST_IDLE,       // time CSR units spent idle in wfi
+  ST_MIGRATE,    // processes moved to another CPU's run queue
+  ST_IPI,        // inter-processor interrupts received
+  ST_SYSCALL,    // first of MAXSYSCALL per-syscall counts
+  NSTAT = ST_SYSCALL + MAXSYSCALL
+};
+
+struct kstats {
+  uint64 time;        // time CSR when the snapshot was taken
+  uint64 n[NSTAT];
+};
+
+// One CPU's counters, on cache lines of its own.
+struct cpustats {
+  uint64 n[NSTAT];
+} __attribute__((aligned(64)));
+
+// Kernel data mapped read-only at VDATA in every process,
+// so programs can read it without a system call.
+struct vdata {
+  uint64 ticks;       // scheduler ticks since boot
+  uint64 timebase;    // time CSR ticks per second
+  uint64 hz;          // scheduler ticks per second
+  struct cpustats cpu[NCPU];
+} __attribute__((aligned(4096)));
+
+// Contention for all spinlocks sharing a name, read with
+// the lockstat() system call.  Times are in time CSR units.
+struct lockstat {
+  char name[16];
+  uint64 nacquire;    // acquisitions
+  uint64 ncontend;    // acquisitions that had to spin
+  uint64 spin;        // total time spent spinning
+  uint64 hold;        // total time held
+  uint64 maxhold;     // longest single hold
+};
+
+// A timer-interrupt sample of what a CPU was running.
+struct profsample {
+  uint64 pc;          // interrupted pc
+  int pid;            // running process, or 0 if idle
+  short cpu;
+  short user;         // 1 if pc is a user address
+  char name[16];      // running process's name
+};
+
+// A traced system call.  Times are time CSR values.
+struct tracerec {
+  uint64 tstart;      // entry
+  uint64 tend;        // return
+  uint64 args[6];     // a0..a5 on entry
+  uint64 ret;
+  int pid;
+  short num;          // system call number
+  short cpu;
+};
@@ -1,13 +1,95 @@
 #include "types.h"
+#ifdef RVV
+#include "param.h"
+#include "riscv.h"
+#include "defs.h"
+#endif
+
+// memset, memmove, memcmp and strlen work a 64-bit word
+// at a time once their pointers are 8-byte aligned, with
+// byte loops for the unaligned head and the tail.
+// Buffers whose alignments differ fall back to bytes.
+
+typedef uint64 word __attribute__((may_alias));
+
+#define WSIZE     sizeof(word)
+#define WALIGNED(p)  (((uint64)(p) & (WSIZE-1)) == 0)
+#define ONES      0x0101010101010101UL
+#define HIGHS     0x8080808080808080UL
+// non-zero if some byte of w is zero.
+#define HASZERO(w)  (((w) - ONES) & ~(w) & HIGHS)
+
+#ifdef RVV
+// with make RVV=1, large memsets and forward copies use
+// the RISC-V vector extension.  xv6 does not save vector
+// registers on traps or context switches, so vector code
+// runs with interrupts off and with sstatus.VS enabled
+// only for its duration.
+
+#define VMIN 128   // bytes; smaller requests use words
+
+static void
+vmemset(char *d, int c, uint n)
+{
+  uint64 vl;
+
+  push_off();
+  w_sstatus(r_sstatus() | SSTATUS_VS_INITIAL);
+  while(n > 0){
+    asm volatile("vsetvli %0, %1, e8, m8, ta, ma\n"
+                 "vmv.v.x v0, %2\n"
+                 "vse8.v v0, (%3)"
+                 : "=&r" (vl) : "r" ((uint64)n), "r" (c), "r" (d) : "memory");
+    d += vl;
+    n -= vl;
+  }
+  w_sstatus(r_sstatus() & ~SSTATUS_VS);
+  pop_off();
+}
+
+static void
+vmemcpy(char *d, const char *s, uint n)
+{
+  uint64 vl;
+
+  push_off();
+  w_sstatus(r_sstatus() | SSTATUS_VS_INITIAL);
+  while(n > 0){
+    asm volatile("vsetvli %0, %1, e8, m8, ta, ma\n"
+                 "vle8.v v0, (%2)\n"
+                 "vse8.v v0, (%3)"
+                 : "=&r" (vl) : "r" ((uint64)n), "r" (s), "r" (d) : "memory");
+    s += vl;
+    d += vl;
+    n -= vl;
+  }
+  w_sstatus(r_sstatus() & ~SSTATUS_VS);
+  pop_off();
+}
+#endif
 
 void*
 memset(void *dst, int c, uint n)
 {
   char *cdst = (char *) dst;
-  int i;
-  for(i = 0; i < n; i++){
-    cdst[i] = c;
+  uint64 w;
+
+#ifdef RVV
+  if(n >= VMIN){
+    vmemset(cdst, c, n);
+    return dst;
+  }
+#endif
+
+  for(; n > 0 && !WALIGNED(cdst); n--)
+    *cdst++ = c;
+  if(n >= WSIZE){
+    w = (uchar)c * ONES;
+    for(; n >= WSIZE; n -= WSIZE, cdst += WSIZE)
+      *(word*)cdst = w;
   }
+  while(n-- > 0)
+    *cdst++ = c;
   return dst;
 }
 
@@ -18,6 +100,15 @@ memcmp(const void *v1, const void *v2, uint n)
 
   s1 = v1;
   s2 = v2;
+  if(((uint64)s1 & (WSIZE-1)) == ((uint64)s2 & (WSIZE-1))){
+    for(; n > 0 && !WALIGNED(s1); n--, s1++, s2++)
+      if(*s1 != *s2)
+        return *s1 - *s2;
+    // skip equal words; the byte loop below
+    // finds the first difference.
+    for(; n >= WSIZE && *(word*)s1 == *(word*)s2; n -= WSIZE)
+      s1 += WSIZE, s2 += WSIZE;
+  }
   while(n-- > 0){
     if(*s1 != *s2)
       return *s1 - *s2;
@@ -32,20 +123,44 @@ memmove(void *dst, const void *src, uint n)
 {
   const char *s;
   char *d;
+  int aligned;
 
   if(n == 0)
     return dst;
   
   s = src;
   d = dst;
+  aligned = ((uint64)s & (WSIZE-1)) == ((uint64)d & (WSIZE-1));
   if(s < d && s + n > d){
     s += n;
     d += n;
+    if(aligned){
+      for(; n > 0 && !WALIGNED(d); n--)
+        *--d = *--s;
+      for(; n >= WSIZE; n -= WSIZE){
+        d -= WSIZE;
+        s -= WSIZE;
+        *(word*)d = *(word*)s;
+      }
+    }
     while(n-- > 0)
       *--d = *--s;
-  } else
+  } else {
+#ifdef RVV
+    if(n >= VMIN && (d + n <= s || s + n <= d)){
+      vmemcpy(d, s, n);
+      return dst;
+    }
+#endif
+    if(aligned){
+      for(; n > 0 && !WALIGNED(d); n--)
+        *d++ = *s++;
+      for(; n >= WSIZE; n -= WSIZE, d += WSIZE, s += WSIZE)
+        *(word*)d = *(word*)s;
+    }
     while(n-- > 0)
       *d++ = *s++;
+  }
 
   return dst;
 }
@@ -98,10 +213,18 @@ safestrcpy(char *s, const char *t, int n)
 int
 strlen(const char *s)
 {
-  int n;
-
-  for(n = 0; s[n]; n++)
+  const char *p;
+  const word *w;
+
+  for(p = s; !WALIGNED(p); p++)
+    if(*p == 0)
+      return p - s;
+  // an aligned word never crosses a page boundary,
+  // so reading past the NUL is safe.
+  for(w = (const word*)p; !HASZERO(*w); w++)
+    ;
+  for(p = (const char*)w; *p; p++)
     ;
-  return n;
+  return p - s;
 }
 
@@ -20,3 +20,21 @@
 #define SYS_link   19
 #define SYS_mkdir  20
 #define SYS_close  21
+#define SYS_kstats 22
+#define SYS_lockstat 23
+#define SYS_profctl 24
+#define SYS_profread 25
+#define SYS_usleep 26
+#define SYS_trace  27
+#define SYS_traceread 28
+#define SYS_mmap   29
+#define SYS_munmap 30
+#define SYS_clone  31
+#define SYS_join   32
+#define SYS_futex  33
+#define SYS_shmget 34
+#define SYS_poll   35
+#define SYS_fcntl  36
+#define SYS_nice   37
+#define SYS_setaffinity 38
+#define SYS_getaffinity 39
@@ -10,28 +10,50 @@
 #include "param.h"
 #include "stat.h"
 #include "spinlock.h"
+#include "sleeplock.h"
 #include "proc.h"
 #include "fs.h"
-#include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
+// If other threads share the file table, one of them could close
+// the descriptor meanwhile, so the caller then gets a reference of
+// its own and argfd() returns 1; pass that to fdput() when done.
 static int
 argfd(int n, int *pfd, struct file **pf)
 {
-  int fd;
+  int fd, ref;
   struct file *f;
+  struct files *fs = myproc()->files;
 
   argint(n, &fd);
-  if(fd < 0 || fd >= NOFILE || (f=myproc()->ofile[fd]) == 0)
+  if(fd < 0 || fd >= NOFILE)
     return -1;
+  // only this thread can raise ref from 1, by clone().
+  if(__atomic_load_n(&fs->ref, __ATOMIC_RELAXED) == 1){
+    if((f = fs->ofile[fd]) == 0)
+      return -1;
+    ref = 0;
+  } else {
+    if((f = fdget(fd)) == 0)
+      return -1;
+    ref = 1;
+  }
   if(pfd)
     *pfd = fd;
   if(pf)
     *pf = f;
-  return 0;
+  return ref;
+}
+
+// Release a file from argfd(), which returned ref.
+static void
+fdput(struct file *f, int ref)
+{
+  if(ref)
+    fileclose(f);
 }
 
 // Allocate a file descriptor for the given file.
@@ -40,28 +62,46 @@ static int
 fdalloc(struct file *f)
 {
   int fd;
-  struct proc *p = myproc();
+  struct files *fs = myproc()->files;
 
+  acquire(&fs->lock);
   for(fd = 0; fd < NOFILE; fd++){
-    if(p->ofile[fd] == 0){
-      p->ofile[fd] = f;
+    if(fs->ofile[fd] == 0){
+      fs->ofile[fd] = f;
+      release(&fs->lock);
       return fd;
     }
   }
+  release(&fs->lock);
   return -1;
 }
 
+// Free file descriptor fd, and return its file for the
+// caller to fileclose(), or 0 if fd was not open.
+static struct file*
+fdfree(int fd)
+{
+  struct file *f;
+  struct files *fs = myproc()->files;
+
+  acquire(&fs->lock);
+  f = fs->ofile[fd];
+  fs->ofile[fd] = 0;
+  release(&fs->lock);
+  return f;
+}
+
 uint64
 sys_dup(void)
 {
   struct file *f;
-  int fd;
+  int fd, ref;
 
-  if(argfd(0, 0, &f) < 0)
+  if((ref = argfd(0, 0, &f)) < 0)
     return -1;
-  if((fd=fdalloc(f)) < 0)
-    return -1;
-  filedup(f);
+  if((fd=fdalloc(f)) >= 0)
+    filedup(f);
+  fdput(f, ref);
   return fd;
 }
 
@@ -69,29 +109,33 @@ uint64
 sys_read(void)
 {
   struct file *f;
-  int n;
+  int n, r, ref;
   uint64 p;
 
   argaddr(1, &p);
   argint(2, &n);
-  if(argfd(0, 0, &f) < 0)
+  if((ref = argfd(0, 0, &f)) < 0)
     return -1;
-  return fileread(f, p, n);
+  r = fileread(f, p, n);
+  fdput(f, ref);
+  return r;
 }
 
 uint64
 sys_write(void)
 {
   struct file *f;
-  int n;
+  int n, r, ref;
   uint64 p;
   
   argaddr(1, &p);
   argint(2, &n);
-  if(argfd(0, 0, &f) < 0)
+  if((ref = argfd(0, 0, &f)) < 0)
     return -1;
 
-  return filewrite(f, p, n);
+  r = filewrite(f, p, n);
+  fdput(f, ref);
+  return r;
 }
 
 uint64
@@ -100,9 +144,9 @@ sys_close(void)
   int fd;
   struct file *f;
 
-  if(argfd(0, &fd, &f) < 0)
+  argint(0, &fd);
+  if(fd < 0 || fd >= NOFILE || (f = fdfree(fd)) == 0)
     return -1;
-  myproc()->ofile[fd] = 0;
   fileclose(f);
   return 0;
 }
@@ -111,12 +155,15 @@ uint64
 sys_fstat(void)
 {
   struct file *f;
+  int r, ref;
   uint64 st; // user pointer to struct stat
 
   argaddr(1, &st);
-  if(argfd(0, 0, &f) < 0)
+  if((ref = argfd(0, 0, &f)) < 0)
     return -1;
-  return filestat(f, st);
+  r = filestat(f, st);
+  fdput(f, ref);
+  return r;
 }
 
 // Create the path new as a link to the same inode as old.
@@ -359,6 +406,7 @@ sys_open(void)
   f->ip = ip;
   f->readable = !(omode & O_WRONLY);
   f->writable = (omode & O_WRONLY) || (omode & O_RDWR);
+  f->nonblock = (omode & O_NONBLOCK) != 0;
 
   if((omode & O_TRUNC) && ip->type == T_FILE){
     itrunc(ip);
@@ -410,8 +458,8 @@ uint64
 sys_chdir(void)
 {
   char path[MAXPATH];
-  struct inode *ip;
-  struct proc *p = myproc();
+  struct inode *ip, *old;
+  struct files *fs = myproc()->files;
   
   begin_op();
   if(argstr(0, path, MAXPATH) < 0 || (ip = namei(path)) == 0){
@@ -425,9 +473,12 @@ sys_chdir(void)
     return -1;
   }
   iunlock(ip);
-  iput(p->cwd);
+  acquire(&fs->lock);
+  old = fs->cwd;
+  fs->cwd = ip;
+  release(&fs->lock);
+  iput(old);
   end_op();
-  p->cwd = ip;
   return 0;
 }
 
@@ -488,18 +539,117 @@ sys_pipe(void)
   fd0 = -1;
   if((fd0 = fdalloc(rf)) < 0 || (fd1 = fdalloc(wf)) < 0){
     if(fd0 >= 0)
-      p->ofile[fd0] = 0;
+      fdfree(fd0);
     fileclose(rf);
     fileclose(wf);
     return -1;
   }
   if(copyout(p->pagetable, fdarray, (char*)&fd0, sizeof(fd0)) < 0 ||
      copyout(p->pagetable, fdarray+sizeof(fd0), (char *)&fd1, sizeof(fd1)) < 0){
-    p->ofile[fd0] = 0;
-    p->ofile[fd1] = 0;
+    fdfree(fd0);
+    fdfree(fd1);
     fileclose(rf);
     fileclose(wf);
     return -1;
   }
   return 0;
 }
+
+// map a file: mmap(addr, len, prot, flags, fd, off).
+// addr is only a hint, and ignored.
+uint64
+sys_mmap(void)
+{
+  uint64 len, r;
+  int prot, flags, off, ref;
+  struct file *f;
+
+  argaddr(1, &len);
+  argint(2, &prot);
+  argint(3, &flags);
+  argint(5, &off);
+  if(off < 0)
+    return -1;
+  if((ref = argfd(4, 0, &f)) < 0)
+    return -1;
+  r = mmap(len, prot, flags, f, off);
+  fdput(f, ref);
+  return r;
+}
+
+// open a shared-memory segment: shmget(key, npages).
+// returns a file descriptor, for mmap().
+uint64
+sys_shmget(void)
+{
+  int key, npages, fd;
+  struct file *f;
+  struct shm *s;
+
+  argint(0, &key);
+  argint(1, &npages);
+  if((s = shmget(key, npages)) == 0)
+    return -1;
+  if((f = filealloc()) == 0){
+    shmclose(s);
+    return -1;
+  }
+  f->type = FD_SHM;
+  f->shm = s;
+  f->readable = 1;
+  f->writable = 1;
+  if((fd = fdalloc(f)) < 0){
+    fileclose(f);
+    return -1;
+  }
+  return fd;
+}
+
+uint64
+sys_munmap(void)
+{
+  uint64 addr, len;
+
+  argaddr(0, &addr);
+  argaddr(1, &len);
+  return munmap(addr, len);
+}
+
+// wait for files to become ready: poll(fds, nfds, timeout).
+// timeout is in milliseconds; negative means forever.
+uint64
+sys_poll(void)
+{
+  uint64 fds;
+  int nfds, timeout;
+
+  argaddr(0, &fds);
+  argint(1, &nfds);
+  argint(2, &timeout);
+  return poll(fds, nfds, timeout);
+}
+
+// get or set a file's flags: fcntl(fd, cmd, flags).
+// only O_NONBLOCK can be set.
+uint64
+sys_fcntl(void)
+{
+  struct file *f;
+  int cmd, flags, r, ref;
+
+  if((ref = argfd(0, 0, &f)) < 0)
+    return -1;
+  argint(1, &cmd);
+  argint(2, &flags);
+  r = -1;
+  if(cmd == F_GETFL){
+    r = f->nonblock ? O_NONBLOCK : 0;
+    if(f->writable)
+      r |= f->readable ? O_RDWR : O_WRONLY;
+  } else if(cmd == F_SETFL){
+    f->nonblock = (flags & O_NONBLOCK) != 0;
+    r = 0;
+  }
+  fdput(f, ref);
+  return r;
+}
@@ -4,7 +4,9 @@
 #include "param.h"
 #include "memlayout.h"
 #include "spinlock.h"
+#include "sleeplock.h"
 #include "proc.h"
+#include "stats.h"
 
 uint64
 sys_exit(void)
@@ -38,34 +40,34 @@ sys_wait(void)
 uint64
 sys_sbrk(void)
 {
-  uint64 addr;
   int n;
 
   argint(0, &n);
-  addr = myproc()->sz;
-  if(growproc(n) < 0)
-    return -1;
-  return addr;
+  return growproc(n);
 }
 
 uint64
 sys_sleep(void)
 {
   int n;
-  uint ticks0;
 
   argint(0, &n);
-  acquire(&tickslock);
-  ticks0 = ticks;
-  while(ticks - ticks0 < n){
-    if(killed(myproc())){
-      release(&tickslock);
-      return -1;
-    }
-    sleep(&ticks, &tickslock);
-  }
-  release(&tickslock);
-  return 0;
+  if(n < 0)
+    n = 0;
+  return sleepuntil(r_time() + (uint64)n * TICKINTERVAL);
+}
+
+// sleep for n microseconds, to the timer's resolution
+// rather than to the next scheduler tick.
+uint64
+sys_usleep(void)
+{
+  int n;
+
+  argint(0, &n);
+  if(n < 0)
+    n = 0;
+  return sleepuntil(r_time() + (uint64)n * (TIMEBASE / 1000000));
 }
 
 uint64
@@ -89,3 +91,163 @@ sys_uptime(void)
   release(&tickslock);
   return xticks;
 }
+
+// copy the kernel event counters of one CPU,
+// or of all CPUs if the cpu argument is -1.
+uint64
+sys_kstats(void)
+{
+  int cpu;
+  uint64 addr;
+  struct kstats ks;
+
+  argint(0, &cpu);
+  argaddr(1, &addr);
+  if(statread(cpu, &ks) < 0)
+    return -1;
+  if(copyout(myproc()->pagetable, addr, (char*)&ks, sizeof(ks)) < 0)
+    return -1;
+  return 0;
+}
+
+// copy up to n lock classes' contention statistics
+// to the user array; return how many were copied, or
+// -1 if the kernel was built without LOCKSTAT.
+uint64
+sys_lockstat(void)
+{
+#ifdef LOCKSTAT
+  uint64 addr;
+  int i, n;
+  struct lockstat ls;
+
+  argaddr(0, &addr);
+  argint(1, &n);
+  for(i = 0; i < n; i++){
+    if(lockstatread(i, &ls) < 0)
+      break;
+    if(copyout(myproc()->pagetable, addr + i*sizeof(ls), (char*)&ls, sizeof(ls)) < 0)
+      return -1;
+  }
+  return i;
+#else
+  return -1;
+#endif
+}
+
+// turn the sampling profiler on or off.
+uint64
+sys_profctl(void)
+{
+  int on;
+
+  argint(0, &on);
+  return profctl(on);
+}
+
+// drain up to n profiler samples into a user array.
+uint64
+sys_profread(void)
+{
+  uint64 addr;
+  int n;
+
+  argaddr(0, &addr);
+  argint(1, &n);
+  return profread(addr, n);
+}
+
+// set the calling process's system call trace mask;
+// return the number of trace records dropped so far.
+uint64
+sys_trace(void)
+{
+  uint64 mask;
+
+  argaddr(0, &mask);
+  traceset(myproc(), mask);
+  return tracedropped();
+}
+
+// drain up to n system call trace records into a user array.
+uint64
+sys_traceread(void)
+{
+  uint64 addr;
+  int n;
+
+  argaddr(0, &addr);
+  argint(1, &n);
+  return traceread(addr, n);
+}
+
+// start a thread of this process at fn(arg), on the
+// given stack; return its thread ID.
+uint64
+sys_clone(void)
+{
+  uint64 fn, arg, stack;
+
+  argaddr(0, &fn);
+  argaddr(1, &arg);
+  argaddr(2, &stack);
+  return clone(fn, arg, stack);
+}
+
+// wait for a thread of this process to exit.
+uint64
+sys_join(void)
+{
+  int tid;
+  uint64 addr;
+
+  argint(0, &tid);
+  argaddr(1, &addr);
+  return join(tid, addr);
+}
+
+// sleep while *addr == val, or wake sleepers on addr.
+uint64
+sys_futex(void)
+{
+  uint64 addr;
+  int op, val;
+
+  argaddr(0, &addr);
+  argint(1, &op);
+  argint(2, &val);
+  return futex(addr, op, val);
+}
+
+// lower (or raise) this process's scheduling priority:
+// nice(incr).  returns the new nice value.
+uint64
+sys_nice(void)
+{
+  int incr;
+
+  argint(0, &incr);
+  return nice(incr);
+}
+
+// restrict a process to some CPUs: setaffinity(pid, mask).
+// pid 0 means the caller; mask has bit 1 << cpuid for each.
+uint64
+sys_setaffinity(void)
+{
+  int pid, mask;
+
+  argint(0, &pid);
+  argint(1, &mask);
+  return setaffinity(pid, mask);
+}
+
+// get a process's CPU mask: getaffinity(pid).
+uint64
+sys_getaffinity(void)
+{
+  int pid;
+
+  argint(0, &pid);
+  return getaffinity(pid);
+}
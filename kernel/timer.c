@@ -0,0 +1,171 @@
+// Timer interrupts and one-shot timers.
+//
+// Each CPU programs its own CLINT mtimecmp from supervisor
+// mode; timervec in kernelvec.S only turns the resulting
+// machine-mode interrupt into a supervisor software interrupt.
+// A busy CPU asks for its next periodic tick (HZ per second)
+// or for the earliest pending one-shot timer, whichever comes
+// first.  An idle CPU drops the periodic tick and sleeps until
+// the earliest timer, but no longer than MAXIDLE.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "proc.h"
+#include "defs.h"
+
+#define MAXIDLE TIMEBASE  // longest tickless idle sleep: one second
+
+// A sleeping process's wakeup time.  Lives on the sleeper's
+// kernel stack while it is on the timers list.
+struct timer {
+  uint64 when;
+  int fired;
+  void *chan;         // what the sleeper sleeps on
+  struct timer *next;
+};
+
+static struct spinlock timerlock;
+static struct timer *timers;        // pending, earliest first
+static uint64 earliest = ~0ULL;     // timers->when, for lock-free peeks
+
+void
+timersinit(void)
+{
+  initlock(&timerlock, "timer");
+}
+
+// Program this CPU's timer for its next deadline.
+void
+timerset(void)
+{
+  struct cpu *c;
+  uint64 when, e;
+
+  push_off();
+  c = mycpu();
+  when = c->idle ? r_time() + MAXIDLE : c->nexttick;
+  e = __atomic_load_n(&earliest, __ATOMIC_RELAXED);
+  if(e < when)
+    when = e;
+  *(volatile uint64*)CLINT_MTIMECMP(cpuid()) = when;
+  pop_off();
+}
+
+// Wake the sleepers whose time has come.
+void
+timerexpire(uint64 now)
+{
+  struct timer *t;
+
+  if(__atomic_load_n(&earliest, __ATOMIC_RELAXED) > now)
+    return;
+  acquire(&timerlock);
+  while((t = timers) != 0 && t->when <= now){
+    timers = t->next;
+    t->fired = 1;
+    wakeup(t->chan);
+  }
+  earliest = timers ? timers->when : ~0ULL;
+  release(&timerlock);
+}
+
+// Put t on the timers list.  Caller holds timerlock.
+static void
+timeradd(struct timer *t)
+{
+  struct timer **pp;
+
+  for(pp = &timers; *pp && (*pp)->when <= t->when; pp = &(*pp)->next)
+    ;
+  t->next = *pp;
+  *pp = t;
+  earliest = timers->when;
+  timerset();
+}
+
+// Take an unfired t off the timers list.
+// Caller holds timerlock.
+static void
+timerdel(struct timer *t)
+{
+  struct timer **pp;
+
+  for(pp = &timers; *pp != t; pp = &(*pp)->next)
+    ;
+  *pp = t->next;
+  earliest = timers ? timers->when : ~0ULL;
+}
+
+// Sleep until the time CSR reaches when.
+// Returns -1 if killed first.
+int
+sleepuntil(uint64 when)
+{
+  struct proc *p = myproc();
+  struct timer t;
+
+  if(r_time() >= when)
+    return 0;
+  t.when = when;
+  t.fired = 0;
+  t.chan = &t;
+
+  acquire(&timerlock);
+  timeradd(&t);
+  while(!t.fired){
+    if(killed(p)){
+      timerdel(&t);
+      release(&timerlock);
+      return -1;
+    }
+    sleep(&t, &timerlock);
+  }
+  release(&timerlock);
+  return 0;
+}
+
+// Sleep until seqwakeup(seq) moves *seq on from seq0,
+// or the time CSR reaches when, whichever comes first.
+// when of ~0 means no time limit.  Lets a caller check
+// some condition, then sleep without missing a wakeup
+// that arrived in between.  Returns -1 if killed.
+int
+seqsleep(int *seq, int seq0, uint64 when)
+{
+  struct proc *p = myproc();
+  struct timer t;
+  int r = 0;
+
+  t.when = when;
+  t.fired = 0;
+  t.chan = seq;
+
+  acquire(&timerlock);
+  if(when != ~0ULL)
+    timeradd(&t);
+  while(*seq == seq0 && !t.fired && r_time() < when){
+    if(killed(p)){
+      r = -1;
+      break;
+    }
+    sleep(seq, &timerlock);
+  }
+  if(when != ~0ULL && !t.fired)
+    timerdel(&t);
+  release(&timerlock);
+  return r;
+}
+
+// Wake a seqsleep() on seq.
+void
+seqwakeup(int *seq)
+{
+  acquire(&timerlock);
+  (*seq)++;
+  wakeup(seq);
+  release(&timerlock);
+}
@@ -0,0 +1,124 @@
+// System call tracing.
+//
+// A process whose trace mask has bit n set records each
+// completed system call n in its CPU's ring: arguments,
+// return value, and entry and exit times.  Like the
+// profiler's rings, each ring has a single producer, which
+// runs with interrupts off so it can't migrate mid-record,
+// and traceread() drains them.  The mask is inherited by
+// fork() and kept across exec().
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "proc.h"
+#include "stats.h"
+#include "defs.h"
+
+struct tracering {
+  uint head;                 // next slot to fill
+  uint tail;                 // next slot to drain
+  struct tracerec r[NTRACEREC];
+} __attribute__((aligned(64)));
+
+static struct tracering rings[NCPU];
+static struct spinlock tracelock;   // serializes readers
+static int ntraced;                 // live processes with a trace mask
+static uint dropped;
+
+void
+traceinit(void)
+{
+  initlock(&tracelock, "trace");
+}
+
+// Set p's trace mask, keeping count of traced processes.
+void
+traceset(struct proc *p, uint64 mask)
+{
+  if(p->tracemask == 0 && mask != 0)
+    __atomic_fetch_add(&ntraced, 1, __ATOMIC_RELAXED);
+  else if(p->tracemask != 0 && mask == 0)
+    __atomic_fetch_sub(&ntraced, 1, __ATOMIC_RELAXED);
+  p->tracemask = mask;
+}
+
+// Record a completed system call.  args holds a0..a5 as
+// they were on entry.
+void
+tracerecord(struct proc *p, int num, uint64 *args, uint64 ret, uint64 t0)
+{
+  struct tracering *ring;
+  struct tracerec *r;
+  uint head;
+
+  push_off();
+  ring = &rings[cpuid()];
+  head = ring->head;
+  if(head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == NTRACEREC){
+    __atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+    pop_off();
+    return;
+  }
+  r = &ring->r[head % NTRACEREC];
+  r->tstart = t0;
+  r->tend = r_time();
+  memmove(r->args, args, sizeof(r->args));
+  r->ret = ret;
+  r->pid = p->pid;
+  r->num = num;
+  r->cpu = cpuid();
+  __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+  pop_off();
+}
+
+// Move up to n records to user address dst.  If there are
+// none yet, wait for some, polling every 10 ms.  Returns the
+// number moved, 0 once no traced process is left and every
+// record has been read, or -1 on error or if killed.
+int
+traceread(uint64 dst, int n)
+{
+  struct tracering *ring;
+  int c, i, last;
+  uint tail;
+
+  for(;;){
+    // read ntraced before draining: records of the last
+    // traced process are published before it exits.
+    last = __atomic_load_n(&ntraced, __ATOMIC_ACQUIRE) == 0;
+
+    acquire(&tracelock);
+    i = 0;
+    for(c = 0; c < NCPU && i < n; c++){
+      ring = &rings[c];
+      for(tail = ring->tail; i < n && tail != __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE); tail++, i++){
+        if(copyout(myproc()->pagetable, dst + i*sizeof(struct tracerec),
+                   (char*)&ring->r[tail % NTRACEREC], sizeof(struct tracerec)) < 0){
+          i = -1;
+          break;
+        }
+      }
+      __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+      if(i < 0)
+        break;
+    }
+    release(&tracelock);
+
+    if(i != 0 || last)
+      return i;
+    if(sleepuntil(r_time() + TIMEBASE/100) < 0)
+      return -1;
+  }
+}
+
+// Return and reset the count of records dropped because
+// a ring was full.
+int
+tracedropped(void)
+{
+  return __atomic_exchange_n(&dropped, 0, __ATOMIC_RELAXED);
+}
@@ -3,7 +3,9 @@
 #include "memlayout.h"
 #include "riscv.h"
 #include "spinlock.h"
+#include "sleeplock.h"
 #include "proc.h"
+#include "stats.h"
 #include "defs.h"
 
 struct spinlock tickslock;
@@ -67,6 +69,13 @@ usertrap(void)
     syscall();
   } else if((which_dev = devintr()) != 0){
     // ok
+  } else if((r_scause() == 13 || r_scause() == 15) &&
+            vmafault(p, r_stval(), r_scause() == 15) == 0){
+    // page fault in a mmap()ed file
+  } else if((r_scause() == 12 || r_scause() == 13 || r_scause() == 15) &&
+            uvmfaultretry(p, r_stval(), r_scause() == 12 ? PTE_X :
+                          r_scause() == 13 ? PTE_R : PTE_W)){
+    // another thread was changing the page's mapping
   } else {
     printf("usertrap(): unexpected scause %p pid=%d\n", r_scause(), p->pid);
     printf("            sepc=%p stval=%p\n", r_sepc(), r_stval());
@@ -76,8 +85,9 @@ usertrap(void)
   if(killed(p))
     exit(-1);
 
-  // give up the CPU if this is a timer interrupt.
-  if(which_dev == 2)
+  // give up the CPU if this is a timer interrupt,
+  // or if a process this one woke should run first.
+  if(which_dev == 2 || p->resched)
     yield();
 
   usertrapret();
@@ -120,13 +130,14 @@ usertrapret(void)
   w_sepc(p->trapframe->epc);
 
   // tell trampoline.S the user page table to switch to.
-  uint64 satp = MAKE_SATP(p->pagetable);
+  uint64 satp = uvmsatp(p);
 
   // jump to userret in trampoline.S at the top of memory, which 
-  // switches to the user page table, restores user registers,
-  // and switches to user mode with sret.
+  // switches to the user page table, restores user registers
+  // from this thread's trapframe, and switches to user mode
+  // with sret.
   uint64 trampoline_userret = TRAMPOLINE + (userret - trampoline);
-  ((void (*)(uint64))trampoline_userret)(satp);
+  ((void (*)(uint64, uint64))trampoline_userret)(satp, TFSLOT(p->tfslot));
 }
 
 // interrupts and exceptions from kernel code go here via kernelvec,
@@ -150,8 +161,10 @@ kerneltrap()
     panic("kerneltrap");
   }
 
-  // give up the CPU if this is a timer interrupt.
-  if(which_dev == 2 && myproc() != 0 && myproc()->state == RUNNING)
+  // give up the CPU if this is a timer interrupt, or if
+  // the interrupt woke a process that should run first.
+  struct proc *p = myproc();
+  if(p != 0 && p->state == RUNNING && (which_dev == 2 || p->resched))
     yield();
 
   // the yield() may have caused some traps to occur,
@@ -160,19 +173,38 @@ kerneltrap()
   w_sstatus(sstatus);
 }
 
-void
+// handle a timer interrupt: bring ticks up to date, fire
+// due one-shot timers, and return 1 if this CPU's scheduler
+// tick has come, so the caller yields.
+int
 clockintr()
 {
-  acquire(&tickslock);
-  ticks++;
-  wakeup(&ticks);
-  release(&tickslock);
+  struct cpu *c = mycpu();
+  uint64 now = r_time();
+  int tick = 0;
+
+  // any CPU's timer interrupt may advance ticks, so that
+  // it keeps counting while idle CPUs skip their ticks.
+  // do it before waking sleepers, which may look at it.
+  if(now / TICKINTERVAL > ticks){
+    acquire(&tickslock);
+    if(now / TICKINTERVAL > ticks)
+      vdata.ticks = ticks = now / TICKINTERVAL;
+    release(&tickslock);
+  }
+  timerexpire(now);
+  if(now >= c->nexttick){
+    tick = 1;
+    c->nexttick = now + TICKINTERVAL;
+  }
+  timerset();
+  return tick;
 }
 
 // check if it's an external interrupt or software interrupt,
 // and handle it.
-// returns 2 if timer interrupt,
-// 1 if other device,
+// returns 2 if a scheduler tick,
+// 1 if other device or timer,
 // 0 if not recognized.
 int
 devintr()
@@ -186,6 +218,8 @@ devintr()
     // irq indicates which device interrupted.
     int irq = plic_claim();
 
+    statinc(ST_INTR);
+
     if(irq == UART0_IRQ){
       uartintr();
     } else if(irq == VIRTIO0_IRQ){
@@ -202,18 +236,21 @@ devintr()
 
     return 1;
   } else if(scause == 0x8000000000000001L){
-    // software interrupt from a machine-mode timer interrupt,
-    // forwarded by timervec in kernelvec.S.
+    // software interrupt from a machine-mode timer interrupt
+    // or IPI, forwarded by timervec in kernelvec.S.
 
-    if(cpuid() == 0){
-      clockintr();
-    }
-    
     // acknowledge the software interrupt by clearing
-    // the SSIP bit in sip.
+    // the SSIP bit in sip.  do it first: clockintr() may
+    // set a deadline that has already passed, and the
+    // interrupt that causes must not be lost.
     w_sip(r_sip() & ~2);
 
-    return 2;
+    statinc(ST_INTR);
+    // an IPI may come with the timer's interrupt, or may hide
+    // it; clockintr() does nothing that is not yet due.
+    if(!ipiintr())
+      profsample();
+    return clockintr() ? 2 : 1;
   } else {
     return 0;
   }
@@ -15,6 +15,7 @@
 #include "fs.h"
 #include "buf.h"
 #include "virtio.h"
+#include "stats.h"
 
 // the address of virtio mmio register r.
 #define R(r) ((volatile uint32 *)(VIRTIO0 + (r)))
@@ -217,6 +218,7 @@ virtio_disk_rw(struct buf *b, int write)
 {
   uint64 sector = b->blockno * (BSIZE / 512);
 
+  statinc(write ? ST_DISKWR : ST_DISKRD);
   acquire(&disk.vdisk_lock);
 
   // the spec's Section 5.2 says that legacy block operations use
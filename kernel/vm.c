@@ -5,6 +5,9 @@
 #include "riscv.h"
 #include "defs.h"
 #include "fs.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "proc.h"
 
 /*
  * the kernel's page table.
@@ -30,6 +33,9 @@ kvmmake(void)
   // virtio mmio disk interface
   kvmmap(kpgtbl, VIRTIO0, VIRTIO0, PGSIZE, PTE_R | PTE_W);
 
+  // CLINT, so each CPU can set its own timer deadline.
+  kvmmap(kpgtbl, CLINT, CLINT, 0x10000, PTE_R | PTE_W);
+
   // PLIC
   kvmmap(kpgtbl, PLIC, PLIC, 0x400000, PTE_R | PTE_W);
 
@@ -37,6 +43,7 @@ kvmmake(void)
   kvmmap(kpgtbl, KERNBASE, KERNBASE, (uint64)etext-KERNBASE, PTE_R | PTE_X);
 
   // map kernel data and the physical RAM we'll make use of.
+  // mappages() uses 2 MB megapages for the aligned bulk of it.
   kvmmap(kpgtbl, (uint64)etext, (uint64)etext, PHYSTOP-(uint64)etext, PTE_R | PTE_W);
 
   // map the trampoline for trap entry/exit to
@@ -70,6 +77,91 @@ kvminithart()
   sfence_vma();
 }
 
+// Address-space IDs.  Each process gets an ID that tags its TLB
+// entries, so satp can switch between the kernel (ID 0) and a
+// process without flushing the TLB.  IDs are handed out in
+// generations: when they run out a new generation starts, each
+// process takes a new ID the next time it returns to user space,
+// and each hart flushes its whole TLB before it uses the new
+// generation's IDs.  So an ID is never reused on a hart without a
+// flush in between.
+struct spinlock asidlock;
+uint64 asidgen = 1;  // current generation
+uint64 nextasid = 1; // next free ID in this generation
+uint64 maxasid;      // largest ID the hardware has; 0 if none
+
+// Find out how many ASID bits the hardware implements:
+// the others read back as zero.
+void
+asidinit(void)
+{
+  uint64 satp = r_satp();
+
+  initlock(&asidlock, "asid");
+  w_satp(satp | SATP_ASIDMASK);
+  maxasid = (r_satp() & SATP_ASIDMASK) >> SATP_ASIDSHIFT;
+  w_satp(satp);
+  sfence_vma();
+}
+
+// Return the satp value with which p should return to user
+// space on this hart, assigning p's address space an ASID if
+// it needs one and flushing any of its stale TLB entries from
+// this hart.  The threads of a process share one ASID.
+// Called with interrupts off.
+uint64
+uvmsatp(struct proc *p)
+{
+  struct cpu *c = mycpu();
+  struct mm *mm = p->mm;
+  uint64 gen, stale, bit = 1L << cpuid();
+
+  if(maxasid == 0)
+    return MAKE_SATP(p->pagetable);  // trampoline.S flushes
+
+  acquire(&asidlock);
+  if(mm->asidgen != asidgen){
+    if(nextasid > maxasid){
+      asidgen++;
+      nextasid = 1;
+    }
+    mm->asid = nextasid++;
+    mm->asidgen = asidgen;
+    mm->tlbstale = ~0L;  // order the page table's writes on every hart
+  }
+  gen = asidgen;
+  release(&asidlock);
+
+  // clear this hart's bit before flushing, so that a change
+  // another thread makes meanwhile sets it again.
+  stale = __sync_fetch_and_and(&mm->tlbstale, ~bit);
+  if(c->asidgen != gen){
+    sfence_vma();
+    c->asidgen = gen;
+  } else if(stale & bit){
+    sfence_vma_asid(mm->asid);
+  }
+  return MAKE_SATP_ASID(p->pagetable, mm->asid);
+}
+
+// Point the empty non-leaf PTE *pte at a new, zeroed page-table
+// page, unless another thread gets there first.  Returns the
+// page *pte now points to, or 0 if out of memory.
+static pagetable_t
+ptalloc(pte_t *pte)
+{
+  pagetable_t pt;
+
+  if((pt = (pagetable_t)kalloc()) == 0)
+    return 0;
+  memset(pt, 0, PGSIZE);
+  if(!__sync_bool_compare_and_swap(pte, 0, PA2PTE(pt) | PTE_V)){
+    kfree((void*)pt);
+    pt = (pagetable_t)PTE2PA(*pte);
+  }
+  return pt;
+}
+
 // Return the address of the PTE in page table pagetable
 // that corresponds to virtual address va.  If alloc!=0,
 // create any required page-table pages.
@@ -82,6 +174,13 @@ kvminithart()
 //   21..29 -- 9 bits of level-1 index.
 //   12..20 -- 9 bits of level-0 index.
 //    0..11 -- 12 bits of byte offset within the page.
+//
+// If va lies in a 2 MB megapage, returns the level-1 leaf
+// PTE, which has PTE_MEGA set.
+//
+// The threads of a process may walk() their shared page
+// table at the same time, so new page-table pages are
+// installed with ptalloc().
 pte_t *
 walk(pagetable_t pagetable, uint64 va, int alloc)
 {
@@ -91,17 +190,57 @@ walk(pagetable_t pagetable, uint64 va, int alloc)
   for(int level = 2; level > 0; level--) {
     pte_t *pte = &pagetable[PX(level, va)];
     if(*pte & PTE_V) {
+      if(*pte & PTE_MEGA)
+        return pte;
       pagetable = (pagetable_t)PTE2PA(*pte);
     } else {
-      if(!alloc || (pagetable = (pde_t*)kalloc()) == 0)
+      if(!alloc || (pagetable = ptalloc(pte)) == 0)
         return 0;
-      memset(pagetable, 0, PGSIZE);
-      *pte = PA2PTE(pagetable) | PTE_V;
     }
   }
   return &pagetable[PX(0, va)];
 }
 
+// Return the address of the level-1 PTE for va, creating
+// the level-1 page-table page if needed.  If that PTE points
+// to a level-0 page that maps nothing, free the page so the
+// slot can hold a megapage.  Returns 0 if out of memory.
+static pte_t *
+walkmega(pagetable_t pagetable, uint64 va)
+{
+  pte_t *pte = &pagetable[PX(2, va)];
+  pagetable_t pt;
+  int i;
+
+  if(*pte & PTE_V) {
+    pagetable = (pagetable_t)PTE2PA(*pte);
+  } else {
+    if((pagetable = ptalloc(pte)) == 0)
+      return 0;
+  }
+
+  pte = &pagetable[PX(1, va)];
+  if(PTE_FLAGS(*pte) == PTE_V){
+    pt = (pagetable_t)PTE2PA(*pte);
+    for(i = 0; i < 512; i++)
+      if(pt[i] & PTE_V)
+        return pte;
+    kfree((void*)pt);
+    *pte = 0;
+  }
+  return pte;
+}
+
+// The physical address of the page containing va,
+// given the leaf PTE that maps it.
+static uint64
+pteaddr(pte_t pte, uint64 va)
+{
+  if(pte & PTE_MEGA)
+    return PTE2PA(pte) + PGROUNDDOWN(va & (MEGAPGSIZE-1));
+  return PTE2PA(pte);
+}
+
 // Look up a virtual address, return the physical address,
 // or 0 if not mapped.
 // Can only be used to look up user pages.
@@ -121,10 +260,152 @@ walkaddr(pagetable_t pagetable, uint64 va)
     return 0;
   if((*pte & PTE_U) == 0)
     return 0;
-  pa = PTE2PA(*pte);
+  pa = pteaddr(*pte, va);
+  return pa;
+}
+
+// Like walkaddr(), but consults the current process's cache
+// of recent translations when pagetable is its page table,
+// so that copies touching the same few pages skip walk().
+// If write is set, also fails for read-only pages, such as
+// the ones at USYSCALL and VDATA.
+static uint64
+uwalkaddr(pagetable_t pagetable, uint64 va, int write)
+{
+  struct proc *p = myproc();
+  struct utlb *e = 0;
+  pte_t *pte;
+  uint64 pa;
+
+  if(va >= MAXVA)
+    return 0;
+
+  if(p && p->pagetable == pagetable){
+    if(p->utlbgen != p->mm->utlbgen){
+      // another thread changed the shared page table.
+      memset(p->utlb, 0, sizeof(p->utlb));
+      p->utlbgen = p->mm->utlbgen;
+    }
+    e = &p->utlb[(va >> PGSHIFT) % NUTLB];
+    if(e->pte && e->va == va)
+      return write && (e->pte & PTE_W) == 0 ? 0 : PTE2PA(e->pte);
+  }
+
+  pte = walk(pagetable, va, 0);
+  if(e && (pte == 0 || (*pte & PTE_V) == 0) && vmafault(p, va, write) == 0)
+    pte = walk(pagetable, va, 0);  // faulted in a mmap()ed page
+  if(pte == 0)
+    return 0;
+  if((*pte & PTE_V) == 0)
+    return 0;
+  if((*pte & PTE_U) == 0)
+    return 0;
+  if(write && (*pte & PTE_W) == 0)
+    return 0;
+  pa = pteaddr(*pte, va);
+  if(e){
+    // cache a 4K-page view of megapage mappings.
+    e->va = va;
+    e->pte = PA2PTE(pa) | (PTE_FLAGS(*pte) & ~PTE_MEGA);
+  }
   return pa;
 }
 
+// Forget the cached translations of p and of the other
+// threads sharing its address space.  Must be called
+// whenever a mapping in p->pagetable is removed or
+// changed, or p->pagetable itself is replaced.
+// The hardware TLB entries are flushed by uvmsatp(),
+// on each hart, before a thread next runs there; harts
+// running one now keep using them until then, so pages
+// must be freed through a pagebatch.
+void
+utlbflush(struct proc *p)
+{
+  memset(p->utlb, 0, sizeof(p->utlb));
+  if(p->mm){
+    p->utlbgen = __sync_add_and_fetch(&p->mm->utlbgen, 1);
+    __sync_fetch_and_or(&p->mm->tlbstale, ~0L);
+  }
+}
+
+// Start collecting pages about to be unmapped from
+// pagetable, to free with pagebatchadd().  They must wait
+// for other harts' TLBs only if pagetable is the current
+// process's and other threads share it.
+void
+pagebatchinit(struct pagebatch *b, pagetable_t pagetable)
+{
+  struct proc *p = myproc();
+
+  b->n = 0;
+  b->p = 0;
+  // ref cannot rise meanwhile: only a thread sharing the
+  // address space could clone() another.
+  if(p && pagetable && p->pagetable == pagetable && p->mm->ref > 1)
+    b->p = p;
+}
+
+// Free the page (megapage, if mega) at pa, whose mapping
+// the caller has just cleared, once no hart can still reach
+// it through a stale TLB entry.
+void
+pagebatchadd(struct pagebatch *b, uint64 pa, int mega)
+{
+  if(b->p == 0){
+    if(mega)
+      megafree((void*)pa);
+    else
+      kfree((void*)pa);
+    return;
+  }
+  if(b->n == NBATCH)
+    pagebatchflush(b);
+  b->pa[b->n++] = pa | (mega != 0);
+}
+
+// Make the threads sharing b's address space forget the
+// mappings cleared so far, then free the pages they mapped.
+void
+pagebatchflush(struct pagebatch *b)
+{
+  uint64 pa;
+  int i;
+
+  if(b->p == 0)
+    return;
+  utlbflush(b->p);
+  tlbshootdown(b->p->mm);
+  for(i = 0; i < b->n; i++){
+    pa = b->pa[i] & ~1L;
+    if(b->pa[i] & 1)
+      megafree((void*)pa);
+    else
+      kfree((void*)pa);
+  }
+  b->n = 0;
+}
+
+// A page fault at va that vmafault() did not resolve may have
+// hit a mapping that another thread was changing under
+// mm->vmlock, as demote() may.  Wait for the change to finish,
+// and return 1 if va is now mapped with perm, so that the
+// faulting instruction can be retried.
+int
+uvmfaultretry(struct proc *p, uint64 va, int perm)
+{
+  pte_t *pte;
+  int ok;
+
+  if(va >= MAXVA)
+    return 0;
+  acquiresleep(&p->mm->vmlock);
+  pte = walk(p->pagetable, va, 0);
+  ok = pte && (*pte & PTE_V) && (*pte & PTE_U) && (*pte & perm);
+  releasesleep(&p->mm->vmlock);
+  return ok;
+}
+
 // add a mapping to the kernel page table.
 // only used when booting.
 // does not flush TLB or enable paging.
@@ -137,7 +418,9 @@ kvmmap(pagetable_t kpgtbl, uint64 va, uint64 pa, uint64 sz, int perm)
 
 // Create PTEs for virtual addresses starting at va that refer to
 // physical addresses starting at pa. va and size might not
-// be page-aligned. Returns 0 on success, -1 if walk() couldn't
+// be page-aligned. Wherever va and pa are both 2 MB-aligned
+// and at least 2 MB remain, a single megapage PTE is used.
+// Returns 0 on success, -1 if walk() couldn't
 // allocate a needed page-table page.
 int
 mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
@@ -148,9 +431,23 @@ mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
   if(size == 0)
     panic("mappages: size");
   
+  perm &= ~PTE_MEGA;
   a = PGROUNDDOWN(va);
   last = PGROUNDDOWN(va + size - 1);
   for(;;){
+    if(a % MEGAPGSIZE == 0 && pa % MEGAPGSIZE == 0 &&
+       last - a >= MEGAPGSIZE - PGSIZE){
+      if((pte = walkmega(pagetable, a)) == 0)
+        return -1;
+      if((*pte & PTE_V) == 0){
+        *pte = PA2PTE(pa) | perm | PTE_MEGA | PTE_V;
+        if(last - a == MEGAPGSIZE - PGSIZE)
+          break;
+        a += MEGAPGSIZE;
+        pa += MEGAPGSIZE;
+        continue;
+      }
+    }
     if((pte = walk(pagetable, a, 1)) == 0)
       return -1;
     if(*pte & PTE_V)
@@ -164,31 +461,89 @@ mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
   return 0;
 }
 
+// Split the megapage mapped by leaf *pte into 512 4K
+// mappings held in a new level-0 page-table page.  The
+// caller is about to unmap the page at va; if it will also
+// free it (do_free) and kalloc() fails, that page becomes
+// the page-table page instead, and demote() returns 1 to
+// say that va is already unmapped.  Otherwise returns 0.
+static int
+demote(pte_t *pte, uint64 va, int do_free, struct pagebatch *b)
+{
+  uint64 pa = PTE2PA(*pte);
+  int flags = PTE_FLAGS(*pte) & ~PTE_MEGA;
+  int i, skip = -1;
+  pagetable_t pt;
+
+  if((pt = (pagetable_t)kalloc()) == 0){
+    if(!do_free)
+      panic("demote");
+    skip = PX(0, va);
+    pt = (pagetable_t)(pa + skip*PGSIZE);
+    if(b->p){
+      // other harts may still write that page through the
+      // megapage; unmap it until they have flushed.  their
+      // faults meanwhile wait in uvmfaultretry().
+      *pte = 0;
+      pagebatchflush(b);
+    }
+  }
+  for(i = 0; i < 512; i++)
+    pt[i] = i == skip ? 0 : PA2PTE(pa + i*PGSIZE) | flags;
+  *pte = PA2PTE(pt) | PTE_V;
+  return skip >= 0;
+}
+
 // Remove npages of mappings starting from va. va must be
 // page-aligned. The mappings must exist.
 // Optionally free the physical memory.
+// A megapage only partly inside the range is first
+// demoted to 4K pages.
 void
 uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
 {
-  uint64 a;
+  uint64 a, end, pa;
   pte_t *pte;
+  struct proc *p = myproc();
+  struct pagebatch b;
 
   if((va % PGSIZE) != 0)
     panic("uvmunmap: not aligned");
 
-  for(a = va; a < va + npages*PGSIZE; a += PGSIZE){
+  // pages are freed only once no hart can reach them.
+  // unmapping without freeing, as of a dead thread's
+  // trapframe, needs no such wait.
+  pagebatchinit(&b, do_free ? pagetable : 0);
+
+  end = va + npages*PGSIZE;
+  for(a = va; a < end; a += PGSIZE){
     if((pte = walk(pagetable, a, 0)) == 0)
       panic("uvmunmap: walk");
     if((*pte & PTE_V) == 0)
       panic("uvmunmap: not mapped");
     if(PTE_FLAGS(*pte) == PTE_V)
       panic("uvmunmap: not a leaf");
-    if(do_free){
-      uint64 pa = PTE2PA(*pte);
-      kfree((void*)pa);
+    if(*pte & PTE_MEGA){
+      if(a % MEGAPGSIZE == 0 && end - a >= MEGAPGSIZE){
+        pa = PTE2PA(*pte);
+        *pte = 0;
+        if(do_free)
+          pagebatchadd(&b, pa, 1);
+        a += MEGAPGSIZE - PGSIZE;
+        continue;
+      }
+      if(demote(pte, a, do_free, &b))
+        continue;
+      pte = walk(pagetable, a, 0);
     }
+    pa = PTE2PA(*pte);
     *pte = 0;
+    if(do_free)
+      pagebatchadd(&b, pa, 0);
   }
+  if(p && p->pagetable == pagetable)
+    utlbflush(p);
+  pagebatchflush(&b);
 }
 
 // create an empty user page table.
@@ -222,25 +577,35 @@ uvmfirst(pagetable_t pagetable, uchar *src, uint sz)
 
 // Allocate PTEs and physical memory to grow process from oldsz to
 // newsz, which need not be page aligned.  Returns new size or 0 on error.
+// If xperm includes PTE_MEGA, 2 MB-aligned stretches of the new
+// range are backed by megapages while any are free.
 uint64
 uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz, int xperm)
 {
   char *mem;
-  uint64 a;
+  uint64 a, sz;
 
   if(newsz < oldsz)
     return oldsz;
 
   oldsz = PGROUNDUP(oldsz);
-  for(a = oldsz; a < newsz; a += PGSIZE){
-    mem = kalloc();
+  for(a = oldsz; a < newsz; a += sz){
+    sz = PGSIZE;
+    if((xperm & PTE_MEGA) && a % MEGAPGSIZE == 0 && newsz - a >= MEGAPGSIZE &&
+       (mem = megaalloc()) != 0)
+      sz = MEGAPGSIZE;
+    else
+      mem = kalloc();
     if(mem == 0){
       uvmdealloc(pagetable, a, oldsz);
       return 0;
     }
-    memset(mem, 0, PGSIZE);
-    if(mappages(pagetable, a, PGSIZE, (uint64)mem, PTE_R|PTE_U|xperm) != 0){
-      kfree(mem);
+    memset(mem, 0, sz);
+    if(mappages(pagetable, a, sz, (uint64)mem, PTE_R|PTE_U|xperm) != 0){
+      if(sz == MEGAPGSIZE)
+        megafree(mem);
+      else
+        kfree(mem);
       uvmdealloc(pagetable, a, oldsz);
       return 0;
     }
@@ -299,7 +664,10 @@ uvmfree(pagetable_t pagetable, uint64 sz)
 // Given a parent process's page table, copy
 // its memory into a child's page table.
 // Copies both the page table and the
-// physical memory.
+// physical memory.  Megapages are copied into
+// megapages if any are free, else into 4K pages.
+// Read-only pages, such as shared program text, are
+// not copied: the child shares them.
 // returns 0 on success, -1 on failure.
 // frees any allocated pages on failure.
 int
@@ -315,8 +683,23 @@ uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
       panic("uvmcopy: pte should exist");
     if((*pte & PTE_V) == 0)
       panic("uvmcopy: page not present");
-    pa = PTE2PA(*pte);
+    pa = pteaddr(*pte, i);
     flags = PTE_FLAGS(*pte);
+    if((flags & PTE_MEGA) && i % MEGAPGSIZE == 0 && (mem = megaalloc()) != 0){
+      memmove(mem, (char*)pa, MEGAPGSIZE);
+      if(mappages(new, i, MEGAPGSIZE, (uint64)mem, flags) != 0){
+        megafree(mem);
+        goto err;
+      }
+      i += MEGAPGSIZE - PGSIZE;
+      continue;
+    }
+    if((flags & (PTE_W|PTE_MEGA)) == 0){
+      if(mappages(new, i, PGSIZE, pa, flags) != 0)
+        goto err;
+      kdup((void*)pa);
+      continue;
+    }
     if((mem = kalloc()) == 0)
       goto err;
     memmove(mem, (char*)pa, PGSIZE);
@@ -339,10 +722,29 @@ uvmclear(pagetable_t pagetable, uint64 va)
 {
   pte_t *pte;
   
+  struct proc *p = myproc();
+
   pte = walk(pagetable, va, 0);
   if(pte == 0)
     panic("uvmclear");
   *pte &= ~PTE_U;
+  if(p && p->pagetable == pagetable)
+    utlbflush(p);
+}
+
+// Fault in any mmap()ed pages of the user range va..va+len
+// that are not mapped yet, so that a copyin() or copyout()
+// made later under a spinlock, which cannot fault, finds them.
+// Stops at the first page that cannot be mapped, where that
+// copy will fail.
+void
+uvmfaultin(pagetable_t pagetable, uint64 va, uint64 len, int write)
+{
+  uint64 a;
+
+  for(a = PGROUNDDOWN(va); a < va + len; a += PGSIZE)
+    if(uwalkaddr(pagetable, a, write) == 0)
+      break;
 }
 
 // Copy from kernel to user.
@@ -355,7 +757,7 @@ copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 
   while(len > 0){
     va0 = PGROUNDDOWN(dstva);
-    pa0 = walkaddr(pagetable, va0);
+    pa0 = uwalkaddr(pagetable, va0, 1);
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (dstva - va0);
@@ -380,7 +782,7 @@ copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
 
   while(len > 0){
     va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
+    pa0 = uwalkaddr(pagetable, va0, 0);
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (srcva - va0);
@@ -407,7 +809,7 @@ copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
 
   while(got_null == 0 && max > 0){
     va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
+    pa0 = uwalkaddr(pagetable, va0, 0);
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (srcva - va0);
@@ -0,0 +1,372 @@
+// Repeatable microbenchmarks, for catching performance
+// regressions from one commit to the next.
+//
+//   bench            run them all
+//   bench name...    run just the named ones
+//
+// Each benchmark runs ROUNDS times; bench prints the best
+// and average round in microseconds, and the best round's
+// rate.  Rounds are timed with the time CSR, read through
+// kstats(), since many finish within a clock tick.
+// "make bench" boots xv6, runs this, and saves the output
+// in bench.out.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/param.h"
+#include "kernel/riscv.h"
+#include "kernel/memlayout.h"
+#include "kernel/stats.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define ROUNDS 3
+
+char buf[8192];
+
+void
+die(char *what)
+{
+  fprintf(2, "bench: %s failed\n", what);
+  exit(1);
+}
+
+// the time CSR.
+uint64
+now(void)
+{
+  struct kstats ks;
+
+  if(kstats(0, &ks) < 0)
+    die("kstats");
+  return ks.time;
+}
+
+// each returns the number of units of work it did:
+// operations, or bytes for throughput benchmarks.
+
+int
+forkexec(void)
+{
+  enum { N = 40 };
+  char *argv[] = { "bench", "-nop", 0 };
+  int i, pid;
+
+  for(i = 0; i < N; i++){
+    if((pid = fork()) < 0)
+      die("fork");
+    if(pid == 0){
+      exec("bench", argv);
+      die("exec");
+    }
+    wait(0);
+  }
+  return N;
+}
+
+int
+pipethroughput(void)
+{
+  enum { TOTAL = 4*1024*1024, CHUNK = 512 };
+  int fds[2], pid, n, got;
+
+  if(pipe(fds) < 0)
+    die("pipe");
+  if((pid = fork()) < 0)
+    die("fork");
+  if(pid == 0){
+    close(fds[0]);
+    for(n = 0; n < TOTAL; n += CHUNK)
+      if(write(fds[1], buf, CHUNK) != CHUNK)
+        die("write");
+    exit(0);
+  }
+  close(fds[1]);
+  got = 0;
+  while((n = read(fds[0], buf, sizeof(buf))) > 0)
+    got += n;
+  close(fds[0]);
+  wait(0);
+  if(got != TOTAL)
+    die("pipe read");
+  return TOTAL;
+}
+
+// like pipe, but the producer fills buffers in a shared-memory
+// segment that the consumer reads in place: no copies through
+// the kernel.  The two hand buffers back and forth with futex().
+int
+shmthroughput(void)
+{
+  enum { TOTAL = 4*1024*1024, CHUNK = 32*1024, NSLOT = 2 };
+  int fd, pid, k, b, sum;
+  int *full;
+  char *seg;
+
+  if((fd = shmget(0, 1 + NSLOT*CHUNK/4096)) < 0)
+    die("shmget");
+  seg = mmap(0, 4096 + NSLOT*CHUNK, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  if(seg == (char*)-1)
+    die("mmap");
+  close(fd);
+  full = (int*)seg;   // full[b] is set while buffer b holds data
+  if((pid = fork()) < 0)
+    die("fork");
+  if(pid == 0){
+    for(k = 0; k < TOTAL / CHUNK; k++){
+      b = k % NSLOT;
+      while(__atomic_load_n(&full[b], __ATOMIC_ACQUIRE))
+        futex(&full[b], FUTEX_WAIT, 1);
+      memset(seg + 4096 + b*CHUNK, 'b', CHUNK);
+      __atomic_store_n(&full[b], 1, __ATOMIC_RELEASE);
+      futex(&full[b], FUTEX_WAKE, 1);
+    }
+    exit(0);
+  }
+  sum = 0;
+  for(k = 0; k < TOTAL / CHUNK; k++){
+    b = k % NSLOT;
+    while(!__atomic_load_n(&full[b], __ATOMIC_ACQUIRE))
+      futex(&full[b], FUTEX_WAIT, 0);
+    sum += seg[4096 + b*CHUNK + k % CHUNK];
+    __atomic_store_n(&full[b], 0, __ATOMIC_RELEASE);
+    futex(&full[b], FUTEX_WAKE, 1);
+  }
+  wait(0);
+  munmap(seg, 4096 + NSLOT*CHUNK);
+  if(sum != 'b' * (TOTAL / CHUNK))
+    die("shm read");
+  return TOTAL;
+}
+
+int
+pingpong(void)
+{
+  enum { N = 2000 };
+  int p1[2], p2[2], pid, i;
+  char c = 0;
+
+  if(pipe(p1) < 0 || pipe(p2) < 0)
+    die("pipe");
+  if((pid = fork()) < 0)
+    die("fork");
+  if(pid == 0){
+    for(i = 0; i < N; i++){
+      if(read(p1[0], &c, 1) != 1 || write(p2[1], &c, 1) != 1)
+        die("child ping");
+    }
+    exit(0);
+  }
+  for(i = 0; i < N; i++){
+    if(write(p1[1], &c, 1) != 1 || read(p2[0], &c, 1) != 1)
+      die("ping");
+  }
+  wait(0);
+  close(p1[0]); close(p1[1]);
+  close(p2[0]); close(p2[1]);
+  return 2*N;
+}
+
+// create, write, and delete many small files.
+int
+smallfiles(void)
+{
+  enum { N = 50, SIZE = 1024 };
+  char name[8];
+  int i, fd;
+
+  for(i = 0; i < N; i++){
+    name[0] = 'b';
+    name[1] = 's';
+    name[2] = '0' + i / 10;
+    name[3] = '0' + i % 10;
+    name[4] = 0;
+    if((fd = open(name, O_CREATE|O_RDWR)) < 0)
+      die("create");
+    if(write(fd, buf, SIZE) != SIZE)
+      die("write");
+    close(fd);
+  }
+  for(i = 0; i < N; i++){
+    name[2] = '0' + i / 10;
+    name[3] = '0' + i % 10;
+    if((fd = open(name, O_RDONLY)) < 0)
+      die("open");
+    if(read(fd, buf, SIZE) != SIZE)
+      die("read");
+    close(fd);
+    unlink(name);
+  }
+  return 2*N*SIZE;
+}
+
+enum { BIGSIZE = 200*1024 };
+
+int
+bigwrite(void)
+{
+  int fd, n;
+
+  if((fd = open("benchbig", O_CREATE|O_TRUNC|O_WRONLY)) < 0)
+    die("create");
+  for(n = 0; n < BIGSIZE; n += 4096)
+    if(write(fd, buf, 4096) != 4096)
+      die("write");
+  close(fd);
+  return BIGSIZE;
+}
+
+int
+bigread(void)
+{
+  enum { PASSES = 8 };
+  int fd, i, n, total = 0;
+
+  for(i = 0; i < PASSES; i++){
+    if((fd = open("benchbig", O_RDONLY)) < 0)
+      die("open");
+    while((n = read(fd, buf, 4096)) > 0)
+      total += n;
+    close(fd);
+  }
+  if(total != PASSES*BIGSIZE)
+    die("read");
+  return total;
+}
+
+int
+openclose(void)
+{
+  enum { N = 500 };
+  int i, fd;
+
+  for(i = 0; i < N; i++){
+    if((fd = open("README", O_RDONLY)) < 0)
+      die("open");
+    close(fd);
+  }
+  return N;
+}
+
+int
+statrate(void)
+{
+  enum { N = 500 };
+  struct stat st;
+  int i;
+
+  for(i = 0; i < N; i++)
+    if(stat("README", &st) < 0)
+      die("stat");
+  return N;
+}
+
+int
+mkdirunlink(void)
+{
+  enum { N = 50 };
+  int i;
+
+  for(i = 0; i < N; i++){
+    if(mkdir("benchdir") < 0)
+      die("mkdir");
+    if(unlink("benchdir") < 0)
+      die("unlink");
+  }
+  return 2*N;
+}
+
+int
+sbrkgrow(void)
+{
+  enum { N = 1024 };
+  char *p;
+  int i;
+
+  for(i = 0; i < N; i++){
+    if((p = sbrk(4096)) == (char*)-1)
+      die("sbrk");
+    *p = 1;
+  }
+  sbrk(-N*4096);
+  return N;
+}
+
+struct bench {
+  char *name;
+  int (*f)(void);
+  char *unit;        // what f's return value counts
+} benches[] = {
+  { "forkexec",  forkexec,       "ops" },
+  { "pipe",      pipethroughput, "bytes" },
+  { "shm",       shmthroughput,  "bytes" },
+  { "pingpong",  pingpong,       "switches" },
+  { "smallfile", smallfiles,     "bytes" },
+  { "bigwrite",  bigwrite,       "bytes" },
+  { "bigread",   bigread,        "bytes" },
+  { "open",      openclose,      "ops" },
+  { "stat",      statrate,       "ops" },
+  { "mkdir",     mkdirunlink,    "ops" },
+  { "sbrk",      sbrkgrow,       "ops" },
+  { 0, 0, 0 },
+};
+
+void
+run(struct bench *b)
+{
+  struct vdata *v = (struct vdata*)VDATA;
+  uint64 t0, t, best, total, rate, us;
+  int r, n;
+
+  best = 0;
+  total = 0;
+  n = 0;
+  for(r = 0; r < ROUNDS; r++){
+    t0 = now();
+    n = b->f();
+    t = now() - t0;
+    if(best == 0 || t < best)
+      best = t;
+    total += t;
+  }
+  if(best == 0)
+    best = 1;
+  rate = (uint64)n * v->timebase / best;
+  us = v->timebase / 1000000;   // time CSR units per microsecond
+  printf("%s", b->name);
+  for(r = strlen(b->name); r < 10; r++)
+    printf(" ");
+  if(strcmp(b->unit, "bytes") == 0)
+    printf("best %l avg %l us\t%l KB/s\n", best / us, total / ROUNDS / us, rate / 1024);
+  else
+    printf("best %l avg %l us\t%l %s/s\n", best / us, total / ROUNDS / us, rate, b->unit);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct bench *b;
+  int i;
+
+  if(argc == 2 && strcmp(argv[1], "-nop") == 0)
+    exit(0);
+
+  memset(buf, 'b', sizeof(buf));
+  printf("bench: %d rounds\n", ROUNDS);
+  for(b = benches; b->name; b++){
+    if(argc > 1){
+      for(i = 1; i < argc; i++)
+        if(strcmp(argv[i], b->name) == 0)
+          break;
+      if(i == argc)
+        continue;
+    }
+    // bigread needs the file bigwrite makes.
+    if(b->f == bigread && argc > 1)
+      bigwrite();
+    run(b);
+  }
+  unlink("benchbig");
+  printf("bench: done\n");
+  exit(0);
+}
@@ -0,0 +1,145 @@
+// Print the kernel's event counters.
+//
+//   kstats              totals since boot
+//   kstats -c           one column per CPU
+//   kstats cmd args...  run cmd and print what changed meanwhile
+//
+// Only non-zero counters are shown.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/param.h"
+#include "kernel/syscall.h"
+#include "kernel/stats.h"
+#include "user/user.h"
+#include "user/sysnames.h"
+
+char *statnames[ST_SYSCALL] = {
+[ST_BHIT]     "bcache hit",
+[ST_BMISS]    "bcache miss",
+[ST_KALLOC]   "kalloc",
+[ST_KFREE]    "kfree",
+[ST_CSWITCH]  "cswitch",
+[ST_DISKRD]   "disk read",
+[ST_DISKWR]   "disk write",
+[ST_LOCKSPIN] "lock spins",
+[ST_INTR]     "interrupts",
+[ST_PCHIT]    "page cache hit",
+[ST_PCMISS]   "page cache miss",
+[ST_BUSY]     "busy time",
+[ST_IDLE]     "idle time",
+[ST_MIGRATE]  "migrations",
+[ST_IPI]      "ipis",
+};
+
+struct kstats percpu[NCPU];
+
+void
+getstats(int cpu, struct kstats *ks)
+{
+  if(kstats(cpu, ks) < 0){
+    fprintf(2, "kstats: kstats failed\n");
+    exit(1);
+  }
+}
+
+// print the name of counter i, padded to a column.
+void
+printname(int i)
+{
+  char *name, buf[16];
+  int n;
+
+  if(i < ST_SYSCALL){
+    name = statnames[i];
+  } else if(sysnames[i - ST_SYSCALL]){
+    name = sysnames[i - ST_SYSCALL];
+  } else {
+    strcpy(buf, "syscall ");
+    buf[8] = '0' + (i - ST_SYSCALL) / 10;
+    buf[9] = '0' + (i - ST_SYSCALL) % 10;
+    buf[10] = 0;
+    name = buf;
+  }
+  printf("%s", name);
+  for(n = strlen(name); n < 14; n++)
+    printf(" ");
+}
+
+// print the counters that differ between a and b.
+void
+printdiff(struct kstats *a, struct kstats *b)
+{
+  int i, hdr = 0;
+
+  for(i = 0; i < NSTAT; i++){
+    if(b->n[i] == a->n[i])
+      continue;
+    if(i >= ST_SYSCALL && !hdr++)
+      printf("syscalls:\n");
+    printname(i);
+    printf("%l\n", b->n[i] - a->n[i]);
+  }
+}
+
+void
+printcpus(void)
+{
+  int c, i, any;
+
+  for(c = 0; c < NCPU; c++)
+    getstats(c, &percpu[c]);
+
+  printf("              ");
+  for(c = 0; c < NCPU; c++)
+    if(percpu[c].n[ST_INTR])
+      printf("cpu%d\t", c);
+  printf("\n");
+  for(i = 0; i < NSTAT; i++){
+    any = 0;
+    for(c = 0; c < NCPU; c++)
+      any |= percpu[c].n[i] != 0;
+    if(!any)
+      continue;
+    printname(i);
+    for(c = 0; c < NCPU; c++)
+      if(percpu[c].n[ST_INTR])
+        printf("%l\t", percpu[c].n[i]);
+    printf("\n");
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  static struct kstats zero, before, after;
+  int pid;
+
+  if(argc == 2 && strcmp(argv[1], "-c") == 0){
+    printcpus();
+    exit(0);
+  }
+
+  if(argc < 2){
+    getstats(-1, &after);
+    printdiff(&zero, &after);
+    exit(0);
+  }
+
+  getstats(-1, &before);
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "kstats: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    exec(argv[1], argv + 1);
+    fprintf(2, "kstats: exec %s failed\n", argv[1]);
+    exit(1);
+  }
+  wait(0);
+  getstats(-1, &after);
+  printf("\n%s: %l time units\n", argv[1], after.time - before.time);
+  printdiff(&before, &after);
+  exit(0);
+}
@@ -0,0 +1,88 @@
+// Report spinlock contention, for kernels built with
+// make LOCKSTAT=1.
+//
+//   lockstat [-n N]              top N lock classes since boot
+//   lockstat [-n N] cmd args...  top N while cmd runs
+//
+// Classes are ranked by total spin time.  Times are in
+// time CSR units (100 ns in qemu).
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/param.h"
+#include "kernel/stats.h"
+#include "user/user.h"
+
+struct lockstat before[NLOCKCLASS], after[NLOCKCLASS];
+
+int
+getstats(struct lockstat *ls)
+{
+  int n;
+
+  if((n = lockstat(ls, NLOCKCLASS)) < 0){
+    fprintf(2, "lockstat: kernel not built with LOCKSTAT=1\n");
+    exit(1);
+  }
+  return n;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, j, n, top, pid;
+  struct lockstat t;
+
+  top = 10;
+  if(argc > 2 && strcmp(argv[1], "-n") == 0){
+    top = atoi(argv[2]);
+    argc -= 2;
+    argv += 2;
+  }
+
+  if(argc > 1){
+    getstats(before);
+    pid = fork();
+    if(pid < 0){
+      fprintf(2, "lockstat: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      exec(argv[1], argv + 1);
+      fprintf(2, "lockstat: exec %s failed\n", argv[1]);
+      exit(1);
+    }
+    wait(0);
+  }
+  n = getstats(after);
+
+  // subtract the earlier snapshot; classes only ever get
+  // appended, so index i names the same class in both.
+  // maxhold stays the since-boot maximum.
+  for(i = 0; i < n; i++){
+    after[i].nacquire -= before[i].nacquire;
+    after[i].ncontend -= before[i].ncontend;
+    after[i].spin -= before[i].spin;
+    after[i].hold -= before[i].hold;
+  }
+
+  // sort by spin time, most first.
+  for(i = 1; i < n; i++){
+    t = after[i];
+    for(j = i; j > 0 && after[j-1].spin < t.spin; j--)
+      after[j] = after[j-1];
+    after[j] = t;
+  }
+
+  printf("name            acquire contend spin    hold    maxhold\n");
+  for(i = 0; i < n && i < top; i++){
+    if(after[i].nacquire == 0)
+      break;
+    printf("%s", after[i].name);
+    for(j = strlen(after[i].name); j < 16; j++)
+      printf(" ");
+    printf("%l\t%l\t%l\t%l\t%l\n", after[i].nacquire, after[i].ncontend,
+           after[i].spin, after[i].hold, after[i].maxhold);
+  }
+  exit(0);
+}
@@ -0,0 +1,272 @@
+// Microbenchmarks for memory copies.
+//
+// membench mem: times the ulib memset, memmove, memcmp and
+// strlen against the byte-at-a-time versions they replaced,
+// over a range of sizes and alignments.
+//
+// membench copy: times kernel copyin/copyout throughput
+// through pipes and file reads, at several request sizes.
+//
+// membench tlb: walks a large heap one page at a time, first
+// with the heap grown by a single aligned sbrk() (which the
+// kernel maps with 2 MB megapages) and then grown 4 KB at a
+// time (4 KB pages), to show the cost of TLB misses.
+//
+// With no argument, runs all three.  Times are in clock ticks.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+#include "kernel/fcntl.h"
+
+#define BUFSZ  8192
+#define TOTAL  (32*1024*1024)  // bytes processed per measurement
+
+char src[BUFSZ + 64];
+char dst[BUFSZ + 64];
+
+// the byte-at-a-time versions, for comparison.
+
+void*
+bmemset(void *dst, int c, uint n)
+{
+  char *cdst = (char *) dst;
+  int i;
+  for(i = 0; i < n; i++){
+    cdst[i] = c;
+  }
+  return dst;
+}
+
+void*
+bmemmove(void *vdst, const void *vsrc, int n)
+{
+  char *dst;
+  const char *src;
+
+  dst = vdst;
+  src = vsrc;
+  if (src > dst) {
+    while(n-- > 0)
+      *dst++ = *src++;
+  } else {
+    dst += n;
+    src += n;
+    while(n-- > 0)
+      *--dst = *--src;
+  }
+  return vdst;
+}
+
+int
+bmemcmp(const void *s1, const void *s2, uint n)
+{
+  const char *p1 = s1, *p2 = s2;
+  while (n-- > 0) {
+    if (*p1 != *p2) {
+      return *p1 - *p2;
+    }
+    p1++;
+    p2++;
+  }
+  return 0;
+}
+
+uint
+bstrlen(const char *s)
+{
+  int n;
+
+  for(n = 0; s[n]; n++)
+    ;
+  return n;
+}
+
+enum { MEMSET, MEMMOVE, MEMCMP, STRLEN };
+char *opnames[] = { "memset", "memmove", "memcmp", "strlen" };
+
+// run op over n-byte buffers at the given source offset
+// until TOTAL bytes have been processed; return elapsed ticks.
+int
+measure(int op, int fast, int n, int off)
+{
+  int i, iters, t0;
+  volatile int sink = 0;
+
+  memset(src, 'x', sizeof(src));
+  memset(dst, 'x', sizeof(dst));
+  src[off + n] = 0;
+
+  iters = TOTAL / n;
+  t0 = uptime();
+  for(i = 0; i < iters; i++){
+    switch(op){
+    case MEMSET:
+      if(fast) memset(dst, i, n); else bmemset(dst, i, n);
+      break;
+    case MEMMOVE:
+      if(fast) memmove(dst, src + off, n); else bmemmove(dst, src + off, n);
+      break;
+    case MEMCMP:
+      if(fast) sink += memcmp(dst, src + off, n); else sink += bmemcmp(dst, src + off, n);
+      break;
+    case STRLEN:
+      if(fast) sink += strlen(src + off); else sink += bstrlen(src + off);
+      break;
+    }
+  }
+  return uptime() - t0;
+}
+
+void
+membench(void)
+{
+  static int sizes[] = { 16, 64, 512, 4096, BUFSZ };
+  int op, i, off, tb, tw;
+
+  printf("%d MB per measurement; times in ticks\n", TOTAL / (1024*1024));
+  printf("op       size  off   byte   word\n");
+  for(op = MEMSET; op <= STRLEN; op++){
+    for(i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++){
+      for(off = 0; off < 2; off++){
+        if(op == MEMSET && off)
+          continue;
+        tb = measure(op, 0, sizes[i], off);
+        tw = measure(op, 1, sizes[i], off);
+        printf("%s\t%d\t%d\t%d\t%d\n", opnames[op], sizes[i], off, tb, tw);
+      }
+    }
+  }
+}
+
+// push total bytes through a pipe in n-byte writes and reads;
+// return elapsed ticks.
+int
+pipecopy(int n, int total)
+{
+  int fds[2], pid, i, m, t0;
+
+  if(pipe(fds) < 0){
+    fprintf(2, "membench: pipe failed\n");
+    exit(1);
+  }
+  t0 = uptime();
+  if((pid = fork()) < 0){
+    fprintf(2, "membench: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    close(fds[0]);
+    for(i = 0; i < total; i += n)
+      if(write(fds[1], src, n) != n)
+        exit(1);
+    exit(0);
+  }
+  close(fds[1]);
+  while((m = read(fds[0], dst, n)) > 0)
+    ;
+  close(fds[0]);
+  wait(0);
+  return uptime() - t0;
+}
+
+// read the file repeatedly in n-byte reads until total
+// bytes have been copied out; return elapsed ticks.
+int
+filecopy(char *path, int n, int total)
+{
+  int fd, m, t0, tot;
+
+  t0 = uptime();
+  for(tot = 0; tot < total; ){
+    if((fd = open(path, O_RDONLY)) < 0){
+      fprintf(2, "membench: cannot open %s\n", path);
+      exit(1);
+    }
+    while((m = read(fd, dst, n)) > 0)
+      tot += m;
+    close(fd);
+  }
+  return uptime() - t0;
+}
+
+void
+copybench(void)
+{
+  static int sizes[] = { 1, 64, 512, 4096 };
+  int i;
+
+  printf("%d MB per measurement; times in ticks\n", TOTAL / (1024*1024));
+  printf("size  pipe  file\n");
+  for(i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++){
+    // one-byte copies are slow; move less data
+    // and scale the time up.
+    int scale = sizes[i] < 64 ? 64 : 1;
+    printf("%d\t%d\t%d\n", sizes[i],
+           pipecopy(sizes[i], TOTAL / scale) * scale,
+           filecopy("README", sizes[i], TOTAL / scale) * scale);
+  }
+}
+
+#define TLBHEAP  (8*1024*1024)
+#define TLBPASS  256           // walks over the heap per measurement
+
+// touch one word in every page of the n-byte heap at
+// p, TLBPASS times; return elapsed ticks.
+int
+pagewalk(char *p, int n)
+{
+  int i, pass, t0;
+
+  for(i = 0; i < n; i += 4096)
+    p[i] = 1;
+  t0 = uptime();
+  for(pass = 0; pass < TLBPASS; pass++)
+    for(i = 0; i < n; i += 4096)
+      p[i] += pass;
+  return uptime() - t0;
+}
+
+void
+tlbbench(void)
+{
+  char *brk, *p;
+  int i, tmega, tpage;
+
+  // start the heap on a 2 MB boundary.
+  brk = sbrk(0);
+  sbrk((2*1024*1024 - (uint64)brk % (2*1024*1024)) % (2*1024*1024));
+  brk = sbrk(0);
+
+  if((p = sbrk(TLBHEAP)) == (char*)-1){
+    fprintf(2, "membench: sbrk failed\n");
+    exit(1);
+  }
+  tmega = pagewalk(p, TLBHEAP);
+  sbrk(-TLBHEAP);
+
+  for(i = 0; i < TLBHEAP; i += 4096){
+    if(sbrk(4096) == (char*)-1){
+      fprintf(2, "membench: sbrk failed\n");
+      exit(1);
+    }
+  }
+  tpage = pagewalk(brk, TLBHEAP);
+  sbrk(-TLBHEAP);
+
+  printf("%d MB heap, %d passes; times in ticks\n", TLBHEAP / (1024*1024), TLBPASS);
+  printf("2 MB pages\t%d\n", tmega);
+  printf("4 KB pages\t%d\n", tpage);
+}
+
+int
+main(int argc, char *argv[])
+{
+  if(argc < 2 || strcmp(argv[1], "mem") == 0)
+    membench();
+  if(argc < 2 || strcmp(argv[1], "copy") == 0)
+    copybench();
+  if(argc < 2 || strcmp(argv[1], "tlb") == 0)
+    tlbbench();
+  exit(0);
+}
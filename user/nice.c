@@ -0,0 +1,33 @@
+// Run a command at a different priority.
+//
+//   nice [-n incr] cmd args...
+//
+// Adds incr (default 10) to the nice value the command
+// inherits; the kernel keeps the result within -20 to 19.
+// Higher nice values get a smaller share of the CPU.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+int
+main(int argc, char *argv[])
+{
+  int incr = 10;
+
+  argv++;
+  argc--;
+  if(argc >= 2 && strcmp(argv[0], "-n") == 0){
+    incr = argv[1][0] == '-' ? -atoi(argv[1] + 1) : atoi(argv[1]);
+    argv += 2;
+    argc -= 2;
+  }
+  if(argc < 1){
+    fprintf(2, "usage: nice [-n incr] cmd args...\n");
+    exit(1);
+  }
+  nice(incr);
+  exec(argv[0], argv);
+  fprintf(2, "nice: exec %s failed\n", argv[0]);
+  exit(1);
+}
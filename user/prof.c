@@ -0,0 +1,248 @@
+// Sampling profiler front end.
+//
+//   prof [-n N] cmd args...
+//
+// Turns on the kernel's timer-interrupt sampler, runs cmd,
+// and prints the N functions (default 20) that were running
+// most often, kernel and user alike.  Addresses are looked
+// up in kernel.sym and in <name>.sym for each program seen.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/param.h"
+#include "kernel/stats.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define NIMAGE   16
+#define CHUNK    256
+
+struct sym {
+  uint64 addr;
+  char *name;
+  int count;
+};
+
+// a kernel or program image and its symbol table.
+struct image {
+  char name[16];       // process name, or "kernel"
+  int user;
+  struct sym *syms;    // sorted by address
+  int nsym;
+  int unknown;         // samples with no symbol
+} images[NIMAGE];
+int nimage;
+
+struct profsample *samples;
+int nsample;
+
+uint64
+hextoi(char *s, char **end)
+{
+  uint64 x = 0;
+  int d;
+
+  for(;; s++){
+    if(*s >= '0' && *s <= '9')
+      d = *s - '0';
+    else if(*s >= 'a' && *s <= 'f')
+      d = *s - 'a' + 10;
+    else
+      break;
+    x = x*16 + d;
+  }
+  *end = s;
+  return x;
+}
+
+// read a .sym file: lines of "address name".
+void
+loadsyms(struct image *im, char *path)
+{
+  struct stat st;
+  char *buf, *p, *e, *nl;
+  struct sym t;
+  int fd, n, i, j, gap;
+
+  if((fd = open(path, O_RDONLY)) < 0)
+    return;
+  if(fstat(fd, &st) < 0 || (buf = malloc(st.size + 1)) == 0){
+    close(fd);
+    return;
+  }
+  n = read(fd, buf, st.size);
+  close(fd);
+  if(n < 0)
+    n = 0;
+  buf[n] = 0;
+
+  for(n = 0, p = buf; *p; p++)
+    if(*p == '\n')
+      n++;
+  im->syms = malloc((n + 1) * sizeof(struct sym));
+  if(im->syms == 0)
+    return;
+  for(p = buf; *p; p = nl + 1){
+    if((nl = strchr(p, '\n')) == 0)
+      break;
+    *nl = 0;
+    t.addr = hextoi(p, &e);
+    if(e == p || *e != ' ')
+      continue;
+    t.name = e + 1;
+    t.count = 0;
+    im->syms[im->nsym++] = t;
+  }
+
+  // shell sort by address.
+  for(gap = im->nsym / 2; gap > 0; gap /= 2){
+    for(i = gap; i < im->nsym; i++){
+      t = im->syms[i];
+      for(j = i; j >= gap && im->syms[j-gap].addr > t.addr; j -= gap)
+        im->syms[j] = im->syms[j-gap];
+      im->syms[j] = t;
+    }
+  }
+}
+
+struct image*
+getimage(char *name, int user)
+{
+  char path[32];
+  struct image *im;
+  int i;
+
+  for(i = 0; i < nimage; i++)
+    if(images[i].user == user && strcmp(images[i].name, name) == 0)
+      return &images[i];
+  if(nimage == NIMAGE)
+    return 0;
+  im = &images[nimage++];
+  strcpy(im->name, name);
+  im->user = user;
+  strcpy(path, name);
+  strcpy(path + strlen(path), ".sym");
+  loadsyms(im, path);
+  return im;
+}
+
+// the last symbol at or below pc.
+struct sym*
+lookup(struct image *im, uint64 pc)
+{
+  int lo, hi, mid;
+
+  lo = 0;
+  hi = im->nsym - 1;
+  if(hi < 0 || pc < im->syms[0].addr)
+    return 0;
+  while(lo < hi){
+    mid = (lo + hi + 1) / 2;
+    if(im->syms[mid].addr <= pc)
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+  return &im->syms[lo];
+}
+
+void
+drain(void)
+{
+  static int cap;
+  int n;
+
+  for(;;){
+    if(nsample + CHUNK > cap){
+      cap = cap ? 2*cap : 4*CHUNK;
+      if((samples = realloc(samples, cap * sizeof(*samples))) == 0){
+        fprintf(2, "prof: out of memory\n");
+        exit(1);
+      }
+    }
+    if((n = profread(samples + nsample, CHUNK)) <= 0)
+      break;
+    nsample += n;
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct profsample *s;
+  struct image *im;
+  struct sym *sym, *best;
+  int i, j, top, pid, dropped, idle, pct;
+
+  top = 20;
+  if(argc > 2 && strcmp(argv[1], "-n") == 0){
+    top = atoi(argv[2]);
+    argc -= 2;
+    argv += 2;
+  }
+  if(argc < 2){
+    fprintf(2, "usage: prof [-n N] cmd args...\n");
+    exit(1);
+  }
+
+  profctl(1);
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "prof: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    exec(argv[1], argv + 1);
+    fprintf(2, "prof: exec %s failed\n", argv[1]);
+    exit(1);
+  }
+  wait(0);
+  dropped = profctl(0);
+  drain();
+
+  idle = 0;
+  for(i = 0; i < nsample; i++){
+    s = &samples[i];
+    if(s->pid == 0){
+      idle++;
+      continue;
+    }
+    im = getimage(s->user ? s->name : "kernel", s->user);
+    if(im == 0)
+      continue;
+    if((sym = lookup(im, s->pc)) != 0)
+      sym->count++;
+    else
+      im->unknown++;
+  }
+
+  printf("%d samples, %d idle", nsample, idle);
+  if(dropped)
+    printf(", %d dropped", dropped);
+  printf("\n");
+  if(nsample == idle)
+    exit(0);
+
+  // print the busiest symbols, one selection pass each.
+  for(i = 0; i < top; i++){
+    best = 0;
+    im = 0;
+    for(j = 0; j < nimage; j++){
+      for(sym = images[j].syms; sym < images[j].syms + images[j].nsym; sym++){
+        if(sym->count > 0 && (best == 0 || sym->count > best->count)){
+          best = sym;
+          im = &images[j];
+        }
+      }
+    }
+    if(best == 0)
+      break;
+    pct = best->count * 100 / (nsample - idle);
+    printf("%d\t%d%%\t%s\t%s\n", best->count, pct, im->name, best->name);
+    best->count = 0;
+  }
+  for(j = 0; j < nimage; j++)
+    if(images[j].unknown)
+      printf("%d\t\t%s\t(no symbol)\n", images[j].unknown, images[j].name);
+  exit(0);
+}
@@ -0,0 +1,181 @@
+// Trace the system calls of a command and its children.
+//
+//   strace [-c] [-e name,name...] cmd args...
+//
+// Without -c, prints each call as it completes, to stderr:
+//   pid name(a0, a1, a2) = ret   <microseconds>
+// With -c, prints instead a summary per system call: count,
+// total and longest time, and a histogram of latencies in
+// power-of-two microsecond buckets.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/param.h"
+#include "kernel/memlayout.h"
+#include "kernel/syscall.h"
+#include "kernel/stats.h"
+#include "user/user.h"
+#include "user/sysnames.h"
+
+#define NREC   64
+#define NBUCKET 16
+#define USEC(t) ((t) / (TIMEBASE / 1000000))
+
+struct tracerec recs[NREC];
+
+struct summary {
+  int count;
+  uint64 total;      // microseconds
+  uint64 max;
+  int hist[NBUCKET]; // hist[i]: latencies in [2^(i-1), 2^i) us
+} sum[MAXSYSCALL];
+
+// set the bits for a comma-separated list of names.
+uint64
+parsemask(char *list)
+{
+  uint64 mask = 0;
+  char *p, *e;
+  int i, n;
+
+  for(p = list; *p; p = *e ? e + 1 : e){
+    if((e = strchr(p, ',')) == 0)
+      e = p + strlen(p);
+    n = e - p;
+    for(i = 0; i < MAXSYSCALL; i++)
+      if(sysnames[i] && strlen(sysnames[i]) == n && memcmp(sysnames[i], p, n) == 0)
+        break;
+    if(i == MAXSYSCALL){
+      fprintf(2, "strace: unknown system call in %s\n", list);
+      exit(1);
+    }
+    mask |= 1L << i;
+  }
+  return mask;
+}
+
+void
+printrec(struct tracerec *r)
+{
+  char *name = sysnames[r->num];
+
+  if(name)
+    fprintf(2, "%d %s(", r->pid, name);
+  else
+    fprintf(2, "%d syscall%d(", r->pid, r->num);
+  fprintf(2, "%d, %d, %d) = %d\t<%l>\n", (int)r->args[0], (int)r->args[1],
+          (int)r->args[2], (int)r->ret, USEC(r->tend - r->tstart));
+}
+
+void
+account(struct tracerec *r)
+{
+  struct summary *s = &sum[r->num];
+  uint64 us = USEC(r->tend - r->tstart);
+  int b;
+
+  s->count++;
+  s->total += us;
+  if(us > s->max)
+    s->max = us;
+  for(b = 0; b < NBUCKET-1 && (1L << b) <= us; b++)
+    ;
+  s->hist[b]++;
+}
+
+void
+printsummary(void)
+{
+  struct summary *s;
+  int i, b;
+
+  fprintf(2, "syscall     calls  total us  max us\n");
+  for(i = 0; i < MAXSYSCALL; i++){
+    s = &sum[i];
+    if(s->count == 0)
+      continue;
+    fprintf(2, "%s", sysnames[i] ? sysnames[i] : "?");
+    for(b = strlen(sysnames[i] ? sysnames[i] : "?"); b < 12; b++)
+      fprintf(2, " ");
+    fprintf(2, "%d\t%l\t%l\n", s->count, s->total, s->max);
+    fprintf(2, "    us:");
+    for(b = 0; b < NBUCKET; b++)
+      if(s->hist[b])
+        fprintf(2, " <%l:%d", 1L << b, s->hist[b]);
+    fprintf(2, "\n");
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  uint64 mask = ~0L;
+  int summarize = 0, pid, fds[2], n, i, j, dropped;
+  struct tracerec t;
+  char c;
+
+  while(argc > 1 && argv[1][0] == '-'){
+    if(strcmp(argv[1], "-c") == 0){
+      summarize = 1;
+    } else if(strcmp(argv[1], "-e") == 0 && argc > 2){
+      mask = parsemask(argv[2]);
+      argc--;
+      argv++;
+    } else {
+      break;
+    }
+    argc--;
+    argv++;
+  }
+  if(argc < 2){
+    fprintf(2, "usage: strace [-c] [-e name,...] cmd args...\n");
+    exit(1);
+  }
+
+  if(pipe(fds) < 0){
+    fprintf(2, "strace: pipe failed\n");
+    exit(1);
+  }
+  trace(0);  // reset the dropped count
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "strace: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    // turn on tracing, then tell the parent it may start
+    // reading: traceread() returns 0 if nothing is traced.
+    close(fds[0]);
+    trace(mask);
+    close(fds[1]);
+    exec(argv[1], argv + 1);
+    fprintf(2, "strace: exec %s failed\n", argv[1]);
+    exit(1);
+  }
+  close(fds[1]);
+  read(fds[0], &c, 1);
+  close(fds[0]);
+
+  while((n = traceread(recs, NREC)) > 0){
+    // each CPU's records are in order; merge them by start time.
+    for(i = 1; i < n; i++){
+      t = recs[i];
+      for(j = i; j > 0 && recs[j-1].tstart > t.tstart; j--)
+        recs[j] = recs[j-1];
+      recs[j] = t;
+    }
+    for(i = 0; i < n; i++){
+      if(summarize)
+        account(&recs[i]);
+      else
+        printrec(&recs[i]);
+    }
+  }
+  wait(0);
+
+  if(summarize)
+    printsummary();
+  if((dropped = trace(0)) > 0)
+    fprintf(2, "strace: %d records dropped\n", dropped);
+  exit(0);
+}
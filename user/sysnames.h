@@ -0,0 +1,44 @@
+// System call names, indexed by number, for kstats and strace.
+// Include after kernel/syscall.h and kernel/stats.h.
+
+static char *sysnames[MAXSYSCALL] = {
+[SYS_fork]    "fork",
+[SYS_exit]    "exit",
+[SYS_wait]    "wait",
+[SYS_pipe]    "pipe",
+[SYS_read]    "read",
+[SYS_kill]    "kill",
+[SYS_exec]    "exec",
+[SYS_fstat]   "fstat",
+[SYS_chdir]   "chdir",
+[SYS_dup]     "dup",
+[SYS_getpid]  "getpid",
+[SYS_sbrk]    "sbrk",
+[SYS_sleep]   "sleep",
+[SYS_uptime]  "uptime",
+[SYS_open]    "open",
+[SYS_write]   "write",
+[SYS_mknod]   "mknod",
+[SYS_unlink]  "unlink",
+[SYS_link]    "link",
+[SYS_mkdir]   "mkdir",
+[SYS_close]   "close",
+[SYS_kstats]  "kstats",
+[SYS_lockstat] "lockstat",
+[SYS_profctl] "profctl",
+[SYS_profread] "profread",
+[SYS_usleep]  "usleep",
+[SYS_trace]   "trace",
+[SYS_traceread] "traceread",
+[SYS_mmap]    "mmap",
+[SYS_munmap]  "munmap",
+[SYS_clone]   "clone",
+[SYS_join]    "join",
+[SYS_futex]   "futex",
+[SYS_shmget]  "shmget",
+[SYS_poll]    "poll",
+[SYS_fcntl]   "fcntl",
+[SYS_nice]    "nice",
+[SYS_setaffinity] "setaffinity",
+[SYS_getaffinity] "getaffinity",
+};
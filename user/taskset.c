@@ -0,0 +1,75 @@
+// Run a command on a subset of the CPUs.
+//
+//   taskset mask cmd args...
+//   taskset -p mask pid
+//   taskset -p pid
+//
+// mask is in hex, with bit 1 << n for CPU n: taskset 0x2 cmd
+// runs cmd (and the children it forks) on CPU 1 alone.  With
+// -p, changes or prints the mask of a running process.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+int
+parsemask(char *s)
+{
+  int mask = 0, d;
+
+  if(s[0] == '0' && (s[1] == 'x' || s[1] == 'X'))
+    s += 2;
+  for(; *s; s++){
+    if(*s >= '0' && *s <= '9')
+      d = *s - '0';
+    else if(*s >= 'a' && *s <= 'f')
+      d = *s - 'a' + 10;
+    else if(*s >= 'A' && *s <= 'F')
+      d = *s - 'A' + 10;
+    else
+      return 0;
+    mask = mask*16 + d;
+  }
+  return mask;
+}
+
+void
+usage(void)
+{
+  fprintf(2, "usage: taskset mask cmd args... | -p [mask] pid\n");
+  exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int mask, pid;
+
+  if(argc == 3 && strcmp(argv[1], "-p") == 0){
+    pid = atoi(argv[2]);
+    if((mask = getaffinity(pid)) < 0){
+      fprintf(2, "taskset: no process %d\n", pid);
+      exit(1);
+    }
+    printf("pid %d mask 0x%x\n", pid, mask);
+    exit(0);
+  }
+  if(argc == 4 && strcmp(argv[1], "-p") == 0){
+    if((mask = parsemask(argv[2])) == 0)
+      usage();
+    if(setaffinity(atoi(argv[3]), mask) < 0){
+      fprintf(2, "taskset: cannot set mask of %s\n", argv[3]);
+      exit(1);
+    }
+    exit(0);
+  }
+  if(argc < 3 || (mask = parsemask(argv[1])) == 0)
+    usage();
+  if(setaffinity(0, mask) < 0){
+    fprintf(2, "taskset: no CPU in mask %s is running\n", argv[1]);
+    exit(1);
+  }
+  exec(argv[2], argv + 2);
+  fprintf(2, "taskset: exec %s failed\n", argv[2]);
+  exit(1);
+}
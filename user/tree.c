@@ -4,6 +4,13 @@
 #include "kernel/fs.h"
 #include "kernel/fcntl.h"
 
+#define MAXJOBS 8
+
+int njobs = 1;  // -j: worker processes for the top level
+
+void tree_jobs(char *path, int depth, int *last, int nent, int nprint,
+               char *file_ext, int show_size, int show_count, int limit_depth);
+
 /**
  * prints the prefix for the current tree level based on depth 
  *
@@ -110,14 +117,17 @@ contains_valid_file(char *path, char *file_ext) {
             if (file_ext) {
                 char *dot = strrchr(buf, '.');
                 if (dot && strcmp(dot, file_ext) == 0) {
+                    free(buf);
                     close(fd);
                     return 1;
                 }
             } else {
+                free(buf);
                 close(fd);
                 return 1;
             }
         } else if (contains_valid_file(buf, file_ext)) {
+            free(buf);
             close(fd);
             return 1;
         }
@@ -172,10 +182,11 @@ tree(char *path, int depth, int *last, char *file_ext, int show_size, int show_c
             printf("%s/\n", strrchr(path, '/'));
         }
 
-        int file_count = 0, dir_count = 0;
+        int file_count = 0, dir_count = 0, nent = 0;
 
         while (read(fd, &de, sizeof(de)) == sizeof(de)) {
             if (de.inum == 0 || is_special_dir(de.name)) continue;
+            nent++;
 
             memmove(p, de.name, strlen(de.name));
             p[strlen(de.name)] = 0;
@@ -192,7 +203,10 @@ tree(char *path, int depth, int *last, char *file_ext, int show_size, int show_c
 
             close(fd);
             fd = open_directory(path);
-            if (fd < 0) return;
+            if (fd < 0) {
+                free(buf);
+                return;
+            }
 
             while (read(fd, &de, sizeof(de)) == sizeof(de)) {
                 if (de.inum == 0 || is_special_dir(de.name)) continue;
@@ -215,9 +229,20 @@ tree(char *path, int depth, int *last, char *file_ext, int show_size, int show_c
             printf("%s (size: %d bytes)\n", strrchr(path, '/'), st.size);
         }
 
+        if (depth == 0 && njobs > 1) {
+            tree_jobs(path, depth, last, nent, dir_count + file_count,
+                      file_ext, show_size, show_count, limit_depth);
+            free(buf);
+            close(fd);
+            return;
+        }
+
         close(fd);
         fd = open_directory(path);
-        if (fd < 0) return;
+        if (fd < 0) {
+            free(buf);
+            return;
+        }
 
         int i = 0;
         while (read(fd, &de, sizeof(de)) == sizeof(de)) {
@@ -236,6 +261,7 @@ tree(char *path, int depth, int *last, char *file_ext, int show_size, int show_c
         if (file_ext) {
             char *dot = strrchr(path, '.');
             if (!dot || strcmp(dot, file_ext) != 0) {
+                free(buf);
                 close(fd);
                 return;
             }
@@ -254,6 +280,143 @@ tree(char *path, int depth, int *last, char *file_ext, int show_size, int show_c
     close(fd);
 }
 
+/**
+ * reads fd to end of file into a malloc'd buffer
+ *
+ * @param fd - file descriptor to read
+ * @param np - set to the number of bytes read
+ * @return - the buffer, or 0 if out of memory
+ */
+char*
+slurp(int fd, int *np) {
+    int n = 0, cap = 512, m;
+    char *b = malloc(cap);
+
+    while (b && (m = read(fd, b + n, cap - n)) > 0) {
+        n += m;
+        if (n == cap) {
+            cap *= 2;
+            b = realloc(b, cap);
+        }
+    }
+    *np = n;
+    return b;
+}
+
+/**
+ * worker for tree_jobs: prints the subtrees of entries lo..hi-1 of
+ * path, with the output collected in memory and then written to out
+ * in one go, so the worker does not wait on the parent until its
+ * whole run has been scanned
+ *
+ * @param lo, hi - range of entries to print, not counting . and ..
+ * @param out - where to send the output
+ * (other params as in tree_jobs)
+ */
+void
+tree_worker(char *path, int depth, int *last, int lo, int hi, int nprint,
+            char *file_ext, int show_size, int show_count, int limit_depth, int out) {
+    int fds[2], n;
+
+    if (pipe(fds) < 0) {
+        fprintf(2, "tree: pipe failed\n");
+        exit(1);
+    }
+    int pid = fork();
+    if (pid < 0) {
+        fprintf(2, "tree: fork failed\n");
+        exit(1);
+    }
+    if (pid == 0) {
+        // the scanner: output goes to the collector's pipe.
+        close(1);
+        dup(fds[1]);
+        close(fds[0]);
+        close(fds[1]);
+        close(out);
+
+        int fd = open_directory(path);
+        if (fd < 0) exit(1);
+        char *buf = malloc(512);
+        if (!buf) {
+            fprintf(2, "tree: memory allocation failed\n");
+            exit(1);
+        }
+        strcpy(buf, path);
+        char *p = buf + strlen(buf);
+        *p++ = '/';
+
+        struct dirent de;
+        int i = 0;
+        while (i < hi && read(fd, &de, sizeof(de)) == sizeof(de)) {
+            if (de.inum == 0 || is_special_dir(de.name)) continue;
+            if (i >= lo) {
+                memmove(p, de.name, strlen(de.name));
+                p[strlen(de.name)] = 0;
+                last[depth] = (i == nprint - 1);
+                tree(buf, depth + 1, last, file_ext, show_size, show_count, limit_depth);
+            }
+            i++;
+        }
+        exit(0);
+    }
+
+    // the collector.
+    close(fds[1]);
+    char *b = slurp(fds[0], &n);
+    close(fds[0]);
+    wait(0);
+    if (!b) {
+        fprintf(2, "tree: memory allocation failed\n");
+        exit(1);
+    }
+    if (write(out, b, n) != n)
+        exit(1);
+    exit(0);
+}
+
+/**
+ * prints the subtrees of a directory's entries, as the last loop in
+ * tree() does, but splits the entries into njobs runs and scans them
+ * in parallel, one worker process per run; the runs are copied to the
+ * output in order, so it matches a serial walk
+ *
+ * @param nent - number of entries in path, not counting . and ..
+ * @param nprint - number of entries that count towards last[]
+ * (other params as in tree())
+ */
+void
+tree_jobs(char *path, int depth, int *last, int nent, int nprint,
+          char *file_ext, int show_size, int show_count, int limit_depth) {
+    int fds[MAXJOBS][2];
+    char b[512];
+    int j, n;
+
+    for (j = 0; j < njobs; j++) {
+        if (pipe(fds[j]) < 0) {
+            fprintf(2, "tree: pipe failed\n");
+            exit(1);
+        }
+        int pid = fork();
+        if (pid < 0) {
+            fprintf(2, "tree: fork failed\n");
+            exit(1);
+        }
+        if (pid == 0) {
+            close(fds[j][0]);
+            tree_worker(path, depth, last, nent * j / njobs, nent * (j + 1) / njobs,
+                        nprint, file_ext, show_size, show_count, limit_depth, fds[j][1]);
+        }
+        close(fds[j][1]);
+    }
+    for (j = 0; j < njobs; j++) {
+        while ((n = read(fds[j][0], b, sizeof(b))) > 0)
+            write(1, b, n);
+        close(fds[j][0]);
+    }
+    for (j = 0; j < njobs; j++)
+        wait(0);
+}
 
 /**
  * main function to parse command-line arguments and initiate the tree traversal
@@ -295,6 +458,17 @@ main(int argc, char *argv[]) {
                 fprintf(2, "tree: missing argument for -L\n");
                 exit(1);
             }
+        } else if (strcmp(argv[i], "-j") == 0) {
+            if (i + 1 < argc) {
+                njobs = atoi(argv[++i]);
+                if (njobs < 1 || njobs > MAXJOBS) {
+                    fprintf(2, "tree: -j takes 1 to %d\n", MAXJOBS);
+                    exit(1);
+                }
+            } else {
+                fprintf(2, "tree: missing argument for -j\n");
+                exit(1);
+            }
         } else if (argv[i][0] == '-') {
         	fprintf(2, "tree: invalid flag %s\n", argv[i]);
         	exit(1);
@@ -1,8 +1,25 @@
 #include "kernel/types.h"
 #include "kernel/stat.h"
 #include "kernel/fcntl.h"
+#include "kernel/param.h"
+#include "kernel/riscv.h"
+#include "kernel/memlayout.h"
+#include "kernel/stats.h"
 #include "user/user.h"
 
+// memset, memmove, memcmp and strlen work a 64-bit word
+// at a time once their pointers are 8-byte aligned, with
+// byte loops for the unaligned head and the tail.
+
+typedef uint64 word __attribute__((may_alias));
+
+#define WSIZE     sizeof(word)
+#define WALIGNED(p)  (((uint64)(p) & (WSIZE-1)) == 0)
+#define ONES      0x0101010101010101UL
+#define HIGHS     0x8080808080808080UL
+// non-zero if some byte of w is zero.
+#define HASZERO(w)  (((w) - ONES) & ~(w) & HIGHS)
+
 //
 // wrapper so that it's OK if main() does not call exit().
 //
@@ -36,21 +53,36 @@ strcmp(const char *p, const char *q)
 uint
 strlen(const char *s)
 {
-  int n;
+  const char *p;
+  const word *w;
 
-  for(n = 0; s[n]; n++)
+  for(p = s; !WALIGNED(p); p++)
+    if(*p == 0)
+      return p - s;
+  // an aligned word never crosses a page boundary,
+  // so reading past the NUL is safe.
+  for(w = (const word*)p; !HASZERO(*w); w++)
     ;
-  return n;
+  for(p = (const char*)w; *p; p++)
+    ;
+  return p - s;
 }
 
 void*
 memset(void *dst, int c, uint n)
 {
   char *cdst = (char *) dst;
-  int i;
-  for(i = 0; i < n; i++){
-    cdst[i] = c;
+  uint64 w;
+
+  for(; n > 0 && !WALIGNED(cdst); n--)
+    *cdst++ = c;
+  if(n >= WSIZE){
+    w = (uchar)c * ONES;
+    for(; n >= WSIZE; n -= WSIZE, cdst += WSIZE)
+      *(word*)cdst = w;
   }
+  while(n-- > 0)
+    *cdst++ = c;
   return dst;
 }
 
@@ -113,9 +145,10 @@ getline(char **lineptr, uint *n, int fd)
     }
 
     uint new_n = *n * 2;
-    char *new_buf = malloc(new_n);
-    memcpy(new_buf, buf, *n);
-    free(buf);
+    char *new_buf = realloc(buf, new_n);
+    if (new_buf == 0) {
+      return -1;
+    }
 
     buf = new_buf;
 
@@ -157,15 +190,32 @@ memmove(void *vdst, const void *vsrc, int n)
 {
   char *dst;
   const char *src;
+  int aligned;
 
   dst = vdst;
   src = vsrc;
+  aligned = ((uint64)src & (WSIZE-1)) == ((uint64)dst & (WSIZE-1));
   if (src > dst) {
+    if (aligned) {
+      for (; n > 0 && !WALIGNED(dst); n--)
+        *dst++ = *src++;
+      for (; n >= (int)WSIZE; n -= WSIZE, dst += WSIZE, src += WSIZE)
+        *(word*)dst = *(word*)src;
+    }
     while(n-- > 0)
       *dst++ = *src++;
   } else {
     dst += n;
     src += n;
+    if (aligned) {
+      for (; n > 0 && !WALIGNED(dst); n--)
+        *--dst = *--src;
+      for (; n >= (int)WSIZE; n -= WSIZE) {
+        dst -= WSIZE;
+        src -= WSIZE;
+        *(word*)dst = *(word*)src;
+      }
+    }
     while(n-- > 0)
       *--dst = *--src;
   }
@@ -176,6 +226,17 @@ int
 memcmp(const void *s1, const void *s2, uint n)
 {
   const char *p1 = s1, *p2 = s2;
+  if (((uint64)p1 & (WSIZE-1)) == ((uint64)p2 & (WSIZE-1))) {
+    for (; n > 0 && !WALIGNED(p1); n--, p1++, p2++)
+      if (*p1 != *p2)
+        return *p1 - *p2;
+    // skip equal words; the byte loop below
+    // finds the first difference.
+    for (; n >= WSIZE && *(word*)p1 == *(word*)p2; n -= WSIZE) {
+      p1 += WSIZE;
+      p2 += WSIZE;
+    }
+  }
   while (n-- > 0) {
     if (*p1 != *p2) {
       return *p1 - *p2;
@@ -191,3 +252,108 @@ memcpy(void *dst, const void *src, uint n)
 {
   return memmove(dst, src, n);
 }
+
+// getpid() and uptime() read pages that the kernel maps
+// read-only into every process, instead of trapping.
+
+int
+getpid(void)
+{
+  return ((struct usyscall*)USYSCALL)->pid;
+}
+
+int
+uptime(void)
+{
+  return ((volatile struct vdata*)VDATA)->ticks;
+}
+
+// Locks that sleep in futex() rather than spin.  Uncontended
+// operations are a single atomic instruction; the kernel is
+// entered only to wait, or to wake a waiter.
+
+void
+mutex_lock(struct mutex *m)
+{
+  int c = 0;
+
+  if(__atomic_compare_exchange_n(&m->state, &c, 1, 0,
+                                 __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+    return;
+  // mark the mutex contended, so that its holder wakes us.
+  if(c != 2)
+    c = __atomic_exchange_n(&m->state, 2, __ATOMIC_ACQUIRE);
+  while(c != 0){
+    futex(&m->state, FUTEX_WAIT, 2);
+    c = __atomic_exchange_n(&m->state, 2, __ATOMIC_ACQUIRE);
+  }
+}
+
+// Returns 1 if it took the mutex, 0 if the mutex was held.
+int
+mutex_trylock(struct mutex *m)
+{
+  int c = 0;
+
+  return __atomic_compare_exchange_n(&m->state, &c, 1, 0,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+void
+mutex_unlock(struct mutex *m)
+{
+  if(__atomic_exchange_n(&m->state, 0, __ATOMIC_RELEASE) == 2)
+    futex(&m->state, FUTEX_WAKE, 1);
+}
+
+// Release m, sleep until signalled, and take m again.
+// Wakeups may be spurious, so call in a loop that
+// checks the condition.
+void
+cond_wait(struct cond *c, struct mutex *m)
+{
+  int seq = __atomic_load_n(&c->seq, __ATOMIC_RELAXED);
+
+  mutex_unlock(m);
+  futex(&c->seq, FUTEX_WAIT, seq);
+  mutex_lock(m);
+}
+
+void
+cond_signal(struct cond *c)
+{
+  __atomic_add_fetch(&c->seq, 1, __ATOMIC_RELEASE);
+  futex(&c->seq, FUTEX_WAKE, 1);
+}
+
+void
+cond_broadcast(struct cond *c)
+{
+  __atomic_add_fetch(&c->seq, 1, __ATOMIC_RELEASE);
+  futex(&c->seq, FUTEX_WAKE, NPROC);
+}
+
+void
+barrier_init(struct barrier *b, int n)
+{
+  b->n = n;
+  b->count = 0;
+  b->gen = 0;
+}
+
+// Wait until all b->n threads have called barrier_wait().
+void
+barrier_wait(struct barrier *b)
+{
+  int gen = __atomic_load_n(&b->gen, __ATOMIC_ACQUIRE);
+
+  if(__atomic_add_fetch(&b->count, 1, __ATOMIC_ACQ_REL) == b->n){
+    // the last to arrive starts the next round.
+    b->count = 0;
+    __atomic_add_fetch(&b->gen, 1, __ATOMIC_RELEASE);
+    futex(&b->gen, FUTEX_WAKE, NPROC);
+    return;
+  }
+  while(__atomic_load_n(&b->gen, __ATOMIC_ACQUIRE) == gen)
+    futex(&b->gen, FUTEX_WAIT, gen);
+}
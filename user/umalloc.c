@@ -3,88 +3,244 @@
 #include "user/user.h"
 #include "kernel/param.h"
 
-// Memory allocator by Kernighan and Ritchie,
-// The C programming Language, 2nd ed.  Section 8.7.
+// Memory allocator with segregated size classes.
+//
+// Requests of up to MAXSMALL bytes are rounded up to a power-of-two
+// size class and served from that class's free list, so malloc and
+// free of small blocks are O(1).  An empty class is refilled by
+// carving a SLABSIZE slab off the arena.  Larger requests are
+// bump-allocated from the arena and recycled through a first-fit
+// list.  The arena itself grows with sbrk().
 
 typedef long Align;
 
 union header {
   struct {
-    union header *ptr;
-    uint size;
+    union header *next;  // next free block, while on a free list
+    uint size;           // usable bytes following the header
+    uint cls;            // size class, or LARGE
   } s;
-  Align x;
+  Align x[2];
 };
 
 typedef union header Header;
 
-static Header base;
-static Header *freep;
+#define MINSMALL   16          // smallest size class, in bytes
+#define NCLASS     8           // classes 16, 32, ..., 2048
+#define MAXSMALL   (MINSMALL << (NCLASS-1))
+#define LARGE      NCLASS      // cls of a bump-allocated block
+#define SLABSIZE   (4*4096)    // bytes carved per class refill
+#define ARENAGROW  (16*4096)   // minimum sbrk() increment
 
-void
-free(void *ap)
+static Header *freelist[NCLASS];
+static Header *largefree;
+
+// the unused part of the most recent sbrk() region.
+static char *arena;
+static char *arenaend;
+
+static struct mallocstats stats;
+
+static int
+sizeclass(uint nbytes)
 {
-  Header *bp, *p;
-
-  bp = (Header*)ap - 1;
-  for(p = freep; !(bp > p && bp < p->s.ptr); p = p->s.ptr)
-    if(p >= p->s.ptr && (bp > p || bp < p->s.ptr))
-      break;
-  if(bp + bp->s.size == p->s.ptr){
-    bp->s.size += p->s.ptr->s.size;
-    bp->s.ptr = p->s.ptr->s.ptr;
-  } else
-    bp->s.ptr = p->s.ptr;
-  if(p + p->s.size == bp){
-    p->s.size += bp->s.size;
-    p->s.ptr = bp->s.ptr;
-  } else
-    p->s.ptr = bp;
-  freep = p;
+  int c;
+
+  for(c = 0; (MINSMALL << c) < nbytes; c++)
+    ;
+  return c;
 }
 
-static Header*
-morecore(uint nu)
+// Make sure the arena has at least n free bytes,
+// calling sbrk() if necessary.  If the new memory
+// is not contiguous with the old arena (someone
+// else called sbrk()), the old tail is abandoned.
+// Returns 0 if out of memory.
+static int
+morecore(uint n)
 {
   char *p;
-  Header *hp;
+  uint grow;
 
-  if(nu < 4096)
-    nu = 4096;
-  p = sbrk(nu * sizeof(Header));
+  if(arena + n <= arenaend)
+    return 1;
+  grow = n < ARENAGROW ? ARENAGROW : n;
+  grow = (grow + 4095) & ~4095;
+  p = sbrk(grow);
   if(p == (char*)-1)
     return 0;
-  hp = (Header*)p;
-  hp->s.size = nu;
-  free((void*)(hp + 1));
-  return freep;
+  stats.nsbrk++;
+  stats.heapbytes += grow;
+  if(p != arenaend)
+    arena = p;
+  arenaend = p + grow;
+  return 1;
+}
+
+// Carve a fresh slab for size class c into
+// blocks on the class free list.
+static int
+refill(int c)
+{
+  uint size = MINSMALL << c;
+  uint stride = sizeof(Header) + size;
+  uint i, n;
+  Header *h;
+
+  n = SLABSIZE / stride;
+  if(!morecore(n * stride))
+    return 0;
+  for(i = 0; i < n; i++){
+    h = (Header*)arena;
+    h->s.size = size;
+    h->s.cls = c;
+    h->s.next = freelist[c];
+    freelist[c] = h;
+    arena += stride;
+  }
+  return 1;
+}
+
+static void*
+largealloc(uint nbytes)
+{
+  Header *h, **pp;
+  uint size;
+
+  size = (nbytes + sizeof(Header) - 1) & ~(sizeof(Header) - 1);
+
+  for(pp = &largefree; (h = *pp) != 0; pp = &h->s.next){
+    if(h->s.size >= size){
+      *pp = h->s.next;
+      return (void*)(h + 1);
+    }
+  }
+
+  if(!morecore(sizeof(Header) + size))
+    return 0;
+  h = (Header*)arena;
+  h->s.size = size;
+  h->s.cls = LARGE;
+  arena += sizeof(Header) + size;
+  return (void*)(h + 1);
+}
+
+static void
+largefree1(Header *h)
+{
+  Header *p, **pp;
+  int again;
+
+  if((char*)(h + 1) + h->s.size != arena){
+    h->s.next = largefree;
+    largefree = h;
+    return;
+  }
+
+  // h is the last block carved from the arena:
+  // give it back, along with any free blocks
+  // that now border the arena.
+  arena = (char*)h;
+  do {
+    again = 0;
+    for(pp = &largefree; (p = *pp) != 0; pp = &p->s.next){
+      if((char*)(p + 1) + p->s.size == arena){
+        *pp = p->s.next;
+        arena = (char*)p;
+        again = 1;
+        break;
+      }
+    }
+  } while(again);
+}
+
+void
+free(void *ap)
+{
+  Header *h;
+
+  if(ap == 0)
+    return;
+  stats.nfree++;
+  h = (Header*)ap - 1;
+  stats.inuse -= h->s.size;
+  if(h->s.cls < NCLASS){
+    h->s.next = freelist[h->s.cls];
+    freelist[h->s.cls] = h;
+  } else {
+    largefree1(h);
+  }
 }
 
 void*
 malloc(uint nbytes)
 {
-  Header *p, *prevp;
-  uint nunits;
+  Header *h;
+  void *p;
+  int c;
 
-  nunits = (nbytes + sizeof(Header) - 1)/sizeof(Header) + 1;
-  if((prevp = freep) == 0){
-    base.s.ptr = freep = prevp = &base;
-    base.s.size = 0;
+  stats.nmalloc++;
+  if(nbytes > MAXSMALL){
+    if((p = largealloc(nbytes)) != 0)
+      stats.inuse += ((Header*)p - 1)->s.size;
+    return p;
   }
-  for(p = prevp->s.ptr; ; prevp = p, p = p->s.ptr){
-    if(p->s.size >= nunits){
-      if(p->s.size == nunits)
-        prevp->s.ptr = p->s.ptr;
-      else {
-        p->s.size -= nunits;
-        p += p->s.size;
-        p->s.size = nunits;
-      }
-      freep = prevp;
-      return (void*)(p + 1);
+
+  c = sizeclass(nbytes);
+  if(freelist[c] == 0 && !refill(c))
+    return 0;
+  h = freelist[c];
+  freelist[c] = h->s.next;
+  stats.inuse += h->s.size;
+  return (void*)(h + 1);
+}
+
+// Resize the block at ap to nbytes, preserving its contents.
+// Grows in place when the block already has room, or when it
+// is the last block carved from the arena.
+void*
+realloc(void *ap, uint nbytes)
+{
+  Header *h;
+  void *p;
+  uint size;
+
+  if(ap == 0)
+    return malloc(nbytes);
+  if(nbytes == 0){
+    free(ap);
+    return 0;
+  }
+
+  stats.nrealloc++;
+  h = (Header*)ap - 1;
+  if(nbytes <= h->s.size){
+    stats.ninplace++;
+    return ap;
+  }
+
+  if(h->s.cls == LARGE && (char*)ap + h->s.size == arena){
+    size = (nbytes + sizeof(Header) - 1) & ~(sizeof(Header) - 1);
+    if(morecore(size - h->s.size) && (char*)ap + h->s.size == arena){
+      arena += size - h->s.size;
+      stats.inuse += size - h->s.size;
+      h->s.size = size;
+      stats.ninplace++;
+      return ap;
     }
-    if(p == freep)
-      if((p = morecore(nunits)) == 0)
-        return 0;
   }
+
+  if((p = malloc(nbytes)) == 0)
+    return 0;
+  memmove(p, ap, h->s.size);
+  free(ap);
+  return p;
+}
+
+// Report allocator counters, e.g. to compare the
+// allocation behaviour of two versions of a program.
+void
+mallocstats(struct mallocstats *ms)
+{
+  *ms = stats;
 }
@@ -1,4 +1,9 @@
 struct stat;
+struct kstats;
+struct lockstat;
+struct profsample;
+struct tracerec;
+struct pollfd;
 
 // system calls
 int fork(void);
@@ -18,10 +23,27 @@ int link(const char*, const char*);
 int mkdir(const char*);
 int chdir(const char*);
 int dup(int);
-int getpid(void);
 char* sbrk(int);
 int sleep(int);
-int uptime(void);
+int kstats(int, struct kstats*);
+int lockstat(struct lockstat*, int);
+int profctl(int);
+int profread(struct profsample*, int);
+int usleep(int);
+int trace(uint64);
+int traceread(struct tracerec*, int);
+void* mmap(void*, uint, int, int, int, uint);
+int munmap(void*, uint);
+int clone(void (*)(void*), void*, void*);
+int join(int, int*);
+int futex(int*, int, int);
+int shmget(int, int);
+int poll(struct pollfd*, int, int);
+int fcntl(int, int, int);
+int nice(int);
+int setaffinity(int, int);
+int getaffinity(int);
+int sysuptime(void);  // uptime() by system call, which takes tickslock
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -36,8 +58,46 @@ int fgets(int fd, char*, int max);
 int getline(char **lineptr, uint *n, int fd);
 uint strlen(const char*);
 void* memset(void*, int, uint);
-void* malloc(uint);
-void free(void*);
 int atoi(const char*);
 int memcmp(const void *, const void *, uint);
+int getpid(void);
+int uptime(void);
 void *memcpy(void *, const void *, uint);
+
+// ulib.c: sleeping locks for threads (see clone()) and for
+// processes that share memory.  Zero means unlocked, so a
+// zeroed mutex or condition variable is ready to use.
+struct mutex {
+  int state;  // 0 unlocked, 1 locked, 2 locked and contended
+};
+struct cond {
+  int seq;    // bumped by each signal
+};
+struct barrier {
+  int n;      // threads that must arrive
+  int count;  // threads that have arrived this round
+  int gen;    // bumped as each round completes
+};
+void mutex_lock(struct mutex*);
+int mutex_trylock(struct mutex*);
+void mutex_unlock(struct mutex*);
+void cond_wait(struct cond*, struct mutex*);
+void cond_signal(struct cond*);
+void cond_broadcast(struct cond*);
+void barrier_init(struct barrier*, int);
+void barrier_wait(struct barrier*);
+
+// umalloc.c
+struct mallocstats {
+  uint nmalloc;
+  uint nfree;
+  uint nrealloc;
+  uint ninplace;   // reallocs that did not move the block
+  uint nsbrk;      // sbrk() calls made by the allocator
+  uint heapbytes;  // bytes obtained from sbrk()
+  uint inuse;      // bytes currently handed out
+};
+void* malloc(uint);
+void free(void*);
+void* realloc(void*, uint);
+void mallocstats(struct mallocstats*);
@@ -4,9 +4,11 @@
 #include "user/user.h"
 #include "kernel/fs.h"
 #include "kernel/fcntl.h"
+#include "kernel/poll.h"
 #include "kernel/syscall.h"
 #include "kernel/memlayout.h"
 #include "kernel/riscv.h"
+#include "kernel/stats.h"
 
 //
 // Tests xv6 system calls.  usertests without arguments runs them all
@@ -16,6 +18,9 @@
 // kernel printing usertrap messages, which can be ignored if test
 // prints "OK".
 //
+// usertests -j N runs up to N tests at a time, each in a directory
+// of its own, and reports how long each took.
+//
 
 #define BUFSZ  ((MAXOPBLOCKS+2)*BSIZE)
 
@@ -76,9 +81,10 @@ copyin(char *s)
 void
 copyout(char *s)
 {
-  uint64 addrs[] = { 0x80000000LL, 0xffffffffffffffff };
+  // USYSCALL and VDATA are mapped, but read-only.
+  uint64 addrs[] = { 0x80000000LL, 0xffffffffffffffff, USYSCALL, VDATA };
 
-  for(int ai = 0; ai < 2; ai++){
+  for(int ai = 0; ai < sizeof(addrs)/sizeof(addrs[0]); ai++){
     uint64 addr = addrs[ai];
 
     int fd = open("README", 0);
@@ -270,7 +276,7 @@ rwsbrk()
   close(fd);
   unlink("rwsbrk");
 
-  fd = open("README", O_RDONLY);
+  fd = open("/README", O_RDONLY);
   if(fd < 0){
     printf("open(rwsbrk) failed\n");
     exit(1);
@@ -1086,6 +1092,60 @@ mem(char *s)
   }
 }
 
+// exercise the size classes, block reuse, and realloc().
+void
+malloctest(char *s)
+{
+  char *a, *b, *c;
+  struct mallocstats ms0, ms1;
+  int i;
+
+  mallocstats(&ms0);
+
+  // a freed small block is handed straight back.
+  a = malloc(100);
+  free(a);
+  if((b = malloc(90)) != a){
+    printf("%s: small block not reused\n", s);
+    exit(1);
+  }
+  free(b);
+
+  // realloc() keeps the contents, both within a class
+  // and when moving to a large block.
+  a = malloc(20);
+  for(i = 0; i < 20; i++)
+    a[i] = i;
+  if((b = realloc(a, 30)) != a){
+    printf("%s: realloc within class moved\n", s);
+    exit(1);
+  }
+  if((c = realloc(b, 10000)) == 0){
+    printf("%s: realloc failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 20; i++){
+    if(c[i] != i){
+      printf("%s: realloc lost data\n", s);
+      exit(1);
+    }
+  }
+
+  // c is the newest large block, so it can grow in place.
+  c[9999] = 'x';
+  if((a = realloc(c, 20000)) != c || a[9999] != 'x'){
+    printf("%s: realloc of last block moved\n", s);
+    exit(1);
+  }
+  free(a);
+
+  mallocstats(&ms1);
+  if(ms1.nmalloc - ms0.nmalloc < 3 || ms1.inuse != ms0.inuse){
+    printf("%s: bad malloc stats\n", s);
+    exit(1);
+  }
+}
+
 // More file system tests
 
 // two processes write to the same file descriptor
@@ -2117,6 +2177,61 @@ sbrkmuch(char *s)
   }
 }
 
+// a 2 MB-aligned sbrk() is backed by megapages; check that
+// fork copies them and that shrinking the heap into the
+// middle of one splits it without losing the rest.
+void
+sbrkmega(char *s)
+{
+  enum { MEGA=2*1024*1024 };
+  char *oldbrk, *a, *p;
+  int pid, xstatus;
+
+  oldbrk = sbrk(0);
+  sbrk((MEGA - (uint64)oldbrk % MEGA) % MEGA);
+  a = sbrk(2*MEGA);
+  if(a == (char*)0xffffffffffffffffL){
+    printf("%s: sbrk failed\n", s);
+    exit(1);
+  }
+  for(p = a; p < a + 2*MEGA; p += 4096)
+    *p = (p - a) / 4096;
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    for(p = a; p < a + 2*MEGA; p += 4096){
+      if(*p != (char)((p - a) / 4096)){
+        printf("%s: child read wrong value\n", s);
+        exit(1);
+      }
+      *p = 0;
+    }
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(xstatus);
+
+  // cut into the second megapage.
+  sbrk(-(MEGA/2 + 4096));
+  for(p = a; p < a + MEGA + MEGA/2 - 4096; p += 4096){
+    if(*p != (char)((p - a) / 4096)){
+      printf("%s: wrong value after shrink\n", s);
+      exit(1);
+    }
+  }
+  sbrk(MEGA/2 + 4096);
+  if(a[2*MEGA - 4096] != 0){
+    printf("%s: regrown page not zero\n", s);
+    exit(1);
+  }
+  sbrk(-(sbrk(0) - oldbrk));
+}
+
 // can we read the kernel's memory?
 void
 kernmem(char *s)
@@ -2386,7 +2501,7 @@ fsfull()
 void argptest(char *s)
 {
   int fd;
-  fd = open("init", O_RDONLY);
+  fd = open("/init", O_RDONLY);
   if (fd < 0) {
     printf("%s: open failed\n", s);
     exit(1);
@@ -2571,221 +2686,1149 @@ badarg(char *s)
   exit(0);
 }
 
-struct test {
-  void (*f)(char *);
-  char *s;
-} quicktests[] = {
-  {copyin, "copyin"},
-  {copyout, "copyout"},
-  {copyinstr1, "copyinstr1"},
-  {copyinstr2, "copyinstr2"},
-  {copyinstr3, "copyinstr3"},
-  {rwsbrk, "rwsbrk" },
-  {truncate1, "truncate1"},
-  {truncate2, "truncate2"},
-  {truncate3, "truncate3"},
-  {openiputtest, "openiput"},
-  {exitiputtest, "exitiput"},
-  {iputtest, "iput"},
-  {opentest, "opentest"},
-  {writetest, "writetest"},
-  {writebig, "writebig"},
-  {createtest, "createtest"},
-  {dirtest, "dirtest"},
-  {exectest, "exectest"},
-  {pipe1, "pipe1"},
-  {killstatus, "killstatus"},
-  {preempt, "preempt"},
-  {exitwait, "exitwait"},
-  {reparent, "reparent" },
-  {twochildren, "twochildren"},
-  {forkfork, "forkfork"},
-  {forkforkfork, "forkforkfork"},
-  {reparent2, "reparent2"},
-  {mem, "mem"},
-  {sharedfd, "sharedfd"},
-  {fourfiles, "fourfiles"},
-  {createdelete, "createdelete"},
-  {unlinkread, "unlinkread"},
-  {linktest, "linktest"},
-  {concreate, "concreate"},
-  {linkunlink, "linkunlink"},
-  {subdir, "subdir"},
-  {bigwrite, "bigwrite"},
-  {bigfile, "bigfile"},
-  {fourteen, "fourteen"},
-  {rmdot, "rmdot"},
-  {dirfile, "dirfile"},
-  {iref, "iref"},
-  {forktest, "forktest"},
-  {sbrkbasic, "sbrkbasic"},
-  {sbrkmuch, "sbrkmuch"},
-  {kernmem, "kernmem"},
-  {MAXVAplus, "MAXVAplus"},
-  {sbrkfail, "sbrkfail"},
-  {sbrkarg, "sbrkarg"},
-  {validatetest, "validatetest"},
-  {bsstest, "bsstest"},
-  {bigargtest, "bigargtest"},
-  {argptest, "argptest"},
-  {stacktest, "stacktest"},
-  {textwrite, "textwrite"},
-  {pgbug, "pgbug" },
-  {sbrkbugs, "sbrkbugs" },
-  {sbrklast, "sbrklast"},
-  {sbrk8000, "sbrk8000"},
-  {badarg, "badarg" },
-
-  { 0, 0},
-};
-
-//
-// Section with tests that take a fair bit of time
-//
-
-// directory that uses indirect blocks
+// getpid() and uptime() read shared pages instead of
+// making system calls; check them against the kernel.
 void
-bigdir(char *s)
+vdatatest(char *s)
 {
-  enum { N = 500 };
-  int i, fd;
-  char name[10];
+  int pid, cpid, xstatus, t0, fds[2];
+  struct vdata *v = (struct vdata*)VDATA;
 
-  unlink("bd");
-
-  fd = open("bd", O_CREATE);
-  if(fd < 0){
-    printf("%s: bigdir create failed\n", s);
+  if(v->hz != HZ || v->timebase != TIMEBASE){
+    printf("%s: vdata hz %d timebase %d\n", s, (int)v->hz, (int)v->timebase);
     exit(1);
   }
-  close(fd);
-
-  for(i = 0; i < N; i++){
-    name[0] = 'x';
-    name[1] = '0' + (i / 64);
-    name[2] = '0' + (i % 64);
-    name[3] = '\0';
-    if(link("bd", name) != 0){
-      printf("%s: bigdir link(bd, %s) failed\n", s, name);
-      exit(1);
-    }
+  t0 = uptime();
+  sleep(2);
+  if(uptime() < t0 + 2){
+    printf("%s: uptime did not advance\n", s);
+    exit(1);
   }
 
-  unlink("bd");
-  for(i = 0; i < N; i++){
-    name[0] = 'x';
-    name[1] = '0' + (i / 64);
-    name[2] = '0' + (i % 64);
-    name[3] = '\0';
-    if(unlink(name) != 0){
-      printf("%s: bigdir unlink failed", s);
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    cpid = getpid();
+    write(fds[1], &cpid, sizeof(cpid));
+    exit(0);
+  }
+  if(read(fds[0], &cpid, sizeof(cpid)) != sizeof(cpid) || cpid != pid){
+    printf("%s: child has wrong pid\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+  wait(0);
+  // kill() takes a real pid: killing our own child by
+  // the pid fork() returned must work.
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    if(kill(getpid()) < 0)
       exit(1);
-    }
+    for(;;)
+      sleep(1);
+  }
+  wait(&xstatus);
+  if(xstatus != -1){
+    printf("%s: kill(getpid()) did not kill\n", s);
+    exit(1);
   }
 }
 
-// concurrent writes to try to provoke deadlock in the virtio disk
-// driver.
+// usleep() should wait at least as long as asked, but not
+// until some far-off tick: an idle CPU must still wake for it.
 void
-manywrites(char *s)
+usleeptest(char *s)
 {
-  int nchildren = 4;
-  int howmany = 30; // increase to look for deadlock
-  
-  for(int ci = 0; ci < nchildren; ci++){
-    int pid = fork();
-    if(pid < 0){
-      printf("fork failed\n");
+  struct kstats k0, k1;
+  uint64 dt;
+  int i;
+
+  for(i = 0; i < 5; i++){
+    kstats(-1, &k0);
+    if(usleep(20000) != 0){
+      printf("%s: usleep failed\n", s);
       exit(1);
     }
-
-    if(pid == 0){
-      char name[3];
-      name[0] = 'b';
-      name[1] = 'a' + ci;
-      name[2] = '\0';
-      unlink(name);
-      
-      for(int iters = 0; iters < howmany; iters++){
-        for(int i = 0; i < ci+1; i++){
-          int fd = open(name, O_CREATE | O_RDWR);
-          if(fd < 0){
-            printf("%s: cannot create %s\n", s, name);
-            exit(1);
-          }
-          int sz = sizeof(buf);
-          int cc = write(fd, buf, sz);
-          if(cc != sz){
-            printf("%s: write(%d) ret %d\n", s, sz, cc);
-            exit(1);
-          }
-          close(fd);
-        }
-        unlink(name);
-      }
-
-      unlink(name);
-      exit(0);
+    kstats(-1, &k1);
+    dt = k1.time - k0.time;
+    if(dt < 20000 * (TIMEBASE / 1000000)){
+      printf("%s: woke early\n", s);
+      exit(1);
+    }
+    if(dt > TIMEBASE / 2){
+      printf("%s: woke %d ms late\n", s, (int)(dt / (TIMEBASE / 1000)) - 20);
+      exit(1);
     }
   }
-
-  for(int ci = 0; ci < nchildren; ci++){
-    int st = 0;
-    wait(&st);
-    if(st != 0)
-      exit(st);
+  if(usleep(0) != 0 || sleep(0) != 0){
+    printf("%s: zero-length sleep failed\n", s);
+    exit(1);
   }
-  exit(0);
 }
 
-// regression test. does write() with an invalid buffer pointer cause
-// a block to be allocated for a file that is then not freed when the
-// file is deleted? if the kernel has this bug, it will panic: balloc:
-// out of blocks. assumed_free may need to be raised to be more than
-// the number of free blocks. this test takes a long time.
+// copy file src to dst, replacing dst's contents.
 void
-badwrite(char *s)
+copyfile(char *s, char *src, char *dst)
 {
-  int assumed_free = 600;
-  
-  unlink("junk");
-  for(int i = 0; i < assumed_free; i++){
-    int fd = open("junk", O_CREATE|O_WRONLY);
-    if(fd < 0){
-      printf("open junk failed\n");
-      exit(1);
-    }
-    write(fd, (char*)0xffffffffffL, 1);
-    close(fd);
-    unlink("junk");
-  }
+  int fd0, fd1, n;
 
-  int fd = open("junk", O_CREATE|O_WRONLY);
-  if(fd < 0){
-    printf("open junk failed\n");
+  if((fd0 = open(src, O_RDONLY)) < 0 ||
+     (fd1 = open(dst, O_CREATE|O_TRUNC|O_WRONLY)) < 0){
+    printf("%s: cannot copy %s to %s\n", s, src, dst);
     exit(1);
   }
-  if(write(fd, "x", 1) != 1){
-    printf("write failed\n");
-    exit(1);
+  while((n = read(fd0, buf, sizeof(buf))) > 0){
+    if(write(fd1, buf, n) != n){
+      printf("%s: write %s failed\n", s, dst);
+      exit(1);
+    }
   }
-  close(fd);
-  unlink("junk");
-
-  exit(0);
+  close(fd0);
+  close(fd1);
 }
 
-// test the exec() code that cleans up if it runs out
-// of memory. it's really a test that such a condition
-// doesn't cause a panic.
+// run argv[0] and return the start of its output in out.
 void
-execout(char *s)
+runout(char *s, char **argv, char *out, int n)
 {
-  for(int avail = 0; avail < 15; avail++){
-    int pid = fork();
-    if(pid < 0){
-      printf("fork failed\n");
-      exit(1);
+  int fds[2], pid, m, xstatus;
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  if((pid = fork()) < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    close(1);
+    dup(fds[1]);
+    close(fds[0]);
+    close(fds[1]);
+    exec(argv[0], argv);
+    exit(1);
+  }
+  close(fds[1]);
+  memset(out, 0, n);
+  for(m = 0; m < n-1; ){
+    int cc = read(fds[0], out + m, n-1 - m);
+    if(cc <= 0)
+      break;
+    m += cc;
+  }
+  close(fds[0]);
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: %s failed\n", s, argv[0]);
+    exit(1);
+  }
+}
+
+// exec() shares text pages through a cache; rewriting a
+// program file must drop its old pages from the cache.
+void
+textcache(char *s)
+{
+  char *catargv[] = { "tcprog", "tcdata", 0 };
+  char *echoargv[] = { "tcprog", "hello", 0 };
+  char out[32];
+  int fd;
+
+  if((fd = open("tcdata", O_CREATE|O_TRUNC|O_WRONLY)) < 0 ||
+     write(fd, "cached\n", 7) != 7){
+    printf("%s: cannot create tcdata\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  copyfile(s, "cat", "tcprog");
+  runout(s, catargv, out, sizeof(out));
+  runout(s, catargv, out, sizeof(out));  // from the cache
+  if(strcmp(out, "cached\n") != 0){
+    printf("%s: cat copy printed %s\n", s, out);
+    exit(1);
+  }
+
+  copyfile(s, "echo", "tcprog");
+  runout(s, echoargv, out, sizeof(out));
+  if(strcmp(out, "hello\n") != 0){
+    printf("%s: echo copy printed %s\n", s, out);
+    exit(1);
+  }
+  unlink("tcprog");
+  unlink("tcdata");
+}
+
+// mmap() a file shared and private, and check that shared
+// mappings, read(), and fork() all see the same pages.
+void
+mmaptest(char *s)
+{
+  enum { SZ = 2*4096 + 100 };
+  char *p, *q;
+  int fd, fd2, i, pid, xstatus, fds[2];
+
+  unlink("mmapf");
+  if((fd = open("mmapf", O_CREATE|O_RDWR)) < 0){
+    printf("%s: create mmapf failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < SZ; i += 4096){
+    int n = SZ - i < 4096 ? SZ - i : 4096;
+    for(int j = 0; j < n; j++)
+      buf[j] = 'a' + (i + j) % 23;
+    if(write(fd, buf, n) != n){
+      printf("%s: write mmapf failed\n", s);
+      exit(1);
+    }
+  }
+
+  p = mmap(0, SZ, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  q = mmap(0, SZ, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if(p == (char*)-1 || q == (char*)-1){
+    printf("%s: mmap failed\n", s);
+    exit(1);
+  }
+
+  // pipes copy with a lock held, where the kernel cannot
+  // fault in pages; write() and read() of pages not yet
+  // touched must still work.
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  if(write(fds[1], p + 4096, 100) != 100 || read(fds[0], q + 4096, 100) != 100){
+    printf("%s: pipe copy of untouched pages failed\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+
+  for(i = 0; i < SZ; i++){
+    if(p[i] != 'a' + i % 23 || q[i] != 'a' + i % 23){
+      printf("%s: wrong byte %d\n", s, i);
+      exit(1);
+    }
+  }
+  if(p[SZ] != 0){
+    printf("%s: no zeros past end of file\n", s);
+    exit(1);
+  }
+
+  // a private write is not seen by the file; a shared one
+  // is, by read() and by the child.
+  q[0] = 'Q';
+  p[4096] = 'P';
+  if(p[0] != 'a'){
+    printf("%s: private write went to the file\n", s);
+    exit(1);
+  }
+  if((fd2 = open("mmapf", O_RDONLY)) < 0 || read(fd2, buf, 4097) != 4097 ||
+     buf[4096] != 'P'){
+    printf("%s: read() did not see a shared write\n", s);
+    exit(1);
+  }
+  close(fd2);
+  if((pid = fork()) < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    if(p[4096] != 'P' || q[0] != 'Q')
+      exit(1);
+    p[1] = 'C';
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0 || p[1] != 'C'){
+    printf("%s: fork did not share the mapping\n", s);
+    exit(1);
+  }
+
+  if(munmap(p, SZ) < 0 || munmap(q, SZ) < 0){
+    printf("%s: munmap failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  // the shared writes reached the file.
+  if((fd = open("mmapf", O_RDONLY)) < 0 || read(fd, buf, 2) != 2 ||
+     buf[0] != 'a' || buf[1] != 'C'){
+    printf("%s: shared write not in file\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  // the mapping is gone.
+  if((pid = fork()) == 0){
+    *(volatile char*)p;
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != -1){
+    printf("%s: touching unmapped memory did not fault\n", s);
+    exit(1);
+  }
+
+  // read() of one file into an untouched mapping of another
+  // works, and two processes doing it crosswise don't
+  // deadlock, each holding one inode's lock.
+  if((fd = open("mmapg", O_CREATE|O_RDWR)) < 0){
+    printf("%s: create mmapg failed\n", s);
+    exit(1);
+  }
+  memset(buf, 'g', 4096);
+  if(write(fd, buf, 4096) != 4096){
+    printf("%s: write mmapg failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  if((pid = fork()) < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 20; i++){
+    fd = open(pid == 0 ? "mmapf" : "mmapg", O_RDONLY);
+    fd2 = open(pid == 0 ? "mmapg" : "mmapf", O_RDONLY);
+    p = mmap(0, 4096, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd2, 0);
+    if(fd < 0 || fd2 < 0 || p == (char*)-1 || read(fd, p, 4096) != 4096 ||
+       p[0] != (pid == 0 ? 'a' : 'g')){
+      if(pid == 0)
+        exit(1);
+      printf("%s: read() into another file's mapping failed\n", s);
+      exit(1);
+    }
+    munmap(p, 4096);
+    close(fd);
+    close(fd2);
+  }
+  if(pid == 0)
+    exit(0);
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: read() into another file's mapping failed in child\n", s);
+    exit(1);
+  }
+  unlink("mmapf");
+  unlink("mmapg");
+}
+
+// threads made by clone() share memory, the pid, open files
+// and the current directory; join() collects their exit
+// status; and the first thread's exit() takes the others
+// with it.
+enum { NT = 4 };
+char tstack[NT][4096];
+volatile int tcount;
+int tpid[NT];
+int tfd;
+
+void*
+tstacktop(int i)
+{
+  return (void*)((uint64)(tstack[i] + sizeof(tstack[i])) & ~15L);
+}
+
+void
+threadfn(void *arg)
+{
+  int i = (int)(uint64)arg;
+
+  tpid[i] = getpid();
+  __sync_fetch_and_add(&tcount, 1);
+  if(write(tfd, "x", 1) != 1)
+    exit(1);
+  exit(10 + i);
+}
+
+char *tbrk[NT];
+
+void
+sbrkfn(void *arg)
+{
+  int i = (int)(uint64)arg;
+
+  tbrk[i] = sbrk(4096);
+  exit(0);
+}
+
+int tofd;
+
+// open, close or chdir in a thread, for the others to see.
+void
+filesfn(void *arg)
+{
+  switch((int)(uint64)arg){
+  case 0:
+    tofd = open("threadg", O_CREATE|O_RDWR);
+    break;
+  case 1:
+    close(tofd);
+    break;
+  case 2:
+    chdir("threaddir");
+    break;
+  }
+  exit(0);
+}
+
+void
+tfiles(char *s, int op)
+{
+  int tid;
+
+  if((tid = clone(filesfn, (void*)(uint64)op, tstacktop(0))) < 0 ||
+     join(tid, 0) != tid){
+    printf("%s: clone failed\n", s);
+    exit(1);
+  }
+}
+
+void
+spinfn(void *arg)
+{
+  for(;;)
+    ;
+}
+
+void
+threadtest(char *s)
+{
+  int i, j, fd, pid, xstatus, tid[NT];
+  char *echoargv[] = { "echo", "exec with threads", 0 };
+  struct stat st;
+
+  unlink("threadf");
+  if((tfd = open("threadf", O_CREATE|O_RDWR)) < 0){
+    printf("%s: create threadf failed\n", s);
+    exit(1);
+  }
+  tcount = 0;
+  for(i = 0; i < NT; i++){
+    if((tid[i] = clone(threadfn, (void*)(uint64)i, tstacktop(i))) < 0){
+      printf("%s: clone failed\n", s);
+      exit(1);
+    }
+  }
+  for(i = 0; i < NT; i++){
+    if(join(tid[i], &xstatus) != tid[i] || xstatus != 10 + i){
+      printf("%s: join of thread %d failed\n", s, i);
+      exit(1);
+    }
+  }
+  if(join(tid[0], 0) != -1){
+    printf("%s: joined a thread twice\n", s);
+    exit(1);
+  }
+  if(tcount != NT){
+    printf("%s: threads did not share memory\n", s);
+    exit(1);
+  }
+  for(i = 0; i < NT; i++){
+    if(tpid[i] != getpid()){
+      printf("%s: thread has pid %d, not %d\n", s, tpid[i], getpid());
+      exit(1);
+    }
+  }
+  if(fstat(tfd, &st) < 0 || st.size != NT){
+    printf("%s: threads did not share the open file\n", s);
+    exit(1);
+  }
+  close(tfd);
+  unlink("threadf");
+
+  // threads share the file table and the current directory.
+  unlink("threadg");
+  tfiles(s, 0);
+  if(tofd < 0 || write(tofd, "x", 1) != 1){
+    printf("%s: open() in a thread not shared\n", s);
+    exit(1);
+  }
+  tfiles(s, 1);
+  if(write(tofd, "x", 1) != -1){
+    printf("%s: close() in a thread not shared\n", s);
+    exit(1);
+  }
+  if(mkdir("threaddir") < 0){
+    printf("%s: mkdir threaddir failed\n", s);
+    exit(1);
+  }
+  tfiles(s, 2);
+  if((fd = open("threadg", O_RDONLY)) >= 0 ||
+     (fd = open("../threadg", O_RDONLY)) < 0){
+    printf("%s: chdir() in a thread not shared\n", s);
+    exit(1);
+  }
+  close(fd);
+  if(chdir("..") < 0){
+    printf("%s: chdir .. failed\n", s);
+    exit(1);
+  }
+  unlink("threadg");
+  unlink("threaddir");
+
+  // threads calling sbrk() at once each get their own memory.
+  for(i = 0; i < NT; i++)
+    if((tid[i] = clone(sbrkfn, (void*)(uint64)i, tstacktop(i))) < 0){
+      printf("%s: clone failed\n", s);
+      exit(1);
+    }
+  for(i = 0; i < NT; i++)
+    join(tid[i], 0);
+  for(i = 0; i < NT; i++){
+    if(tbrk[i] == (char*)-1){
+      printf("%s: sbrk in a thread failed\n", s);
+      exit(1);
+    }
+    for(j = 0; j < i; j++){
+      if(tbrk[i] == tbrk[j]){
+        printf("%s: threads' sbrk()s overlap\n", s);
+        exit(1);
+      }
+    }
+  }
+
+  if((pid = fork()) < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    if(clone(spinfn, 0, tstacktop(0)) < 0)
+      exit(1);
+    exec("/echo", echoargv);  // must fail
+    exit(7);
+  }
+  if(wait(&xstatus) != pid || xstatus != 7){
+    printf("%s: exit with a spinning thread failed, status %d\n", s, xstatus);
+    exit(1);
+  }
+}
+
+// threads synchronize with the ulib mutex, condition
+// variable and barrier, which sleep in futex().
+struct mutex fmu;
+struct cond fcv;
+struct barrier fbar;
+int fcount, fready;
+
+void
+futexfn(void *arg)
+{
+  int i, round;
+
+  for(i = 0; i < 1000; i++){
+    mutex_lock(&fmu);
+    fcount++;
+    mutex_unlock(&fmu);
+  }
+
+  // no thread starts a round before all have finished the last.
+  for(round = 0; round < 10; round++){
+    barrier_wait(&fbar);
+    mutex_lock(&fmu);
+    fcount++;
+    mutex_unlock(&fmu);
+    barrier_wait(&fbar);
+    if(fcount != NT*1000 + NT*(round+1))
+      exit(1);
+  }
+
+  mutex_lock(&fmu);
+  while(!fready)
+    cond_wait(&fcv, &fmu);
+  mutex_unlock(&fmu);
+  exit(0);
+}
+
+void
+futextest(char *s)
+{
+  int i, xstatus, tid[NT];
+
+  if(futex(&fcount, FUTEX_WAIT, fcount + 1) != -1){
+    printf("%s: futex slept on a changed value\n", s);
+    exit(1);
+  }
+  if(futex((int*)1, FUTEX_WAIT, 0) != -1){
+    printf("%s: futex accepted a misaligned address\n", s);
+    exit(1);
+  }
+
+  barrier_init(&fbar, NT);
+  for(i = 0; i < NT; i++){
+    if((tid[i] = clone(futexfn, 0, tstacktop(i))) < 0){
+      printf("%s: clone failed\n", s);
+      exit(1);
+    }
+  }
+  sleep(1);
+  mutex_lock(&fmu);
+  fready = 1;
+  cond_broadcast(&fcv);
+  mutex_unlock(&fmu);
+
+  for(i = 0; i < NT; i++){
+    if(join(tid[i], &xstatus) != tid[i] || xstatus != 0){
+      printf("%s: thread %d failed\n", s, i);
+      exit(1);
+    }
+  }
+  if(fcount != NT*1000 + NT*10){
+    printf("%s: count %d, not %d\n", s, fcount, NT*1000 + NT*10);
+    exit(1);
+  }
+}
+
+// a shared-memory segment is shared through fork() and
+// by key, and its mapping outlives the descriptor.
+void
+shmtest(char *s)
+{
+  enum { NPG = 4 };
+  int key = 5000 + getpid();
+  int fd, pid, xstatus, i;
+  char *p, *q;
+
+  if((fd = shmget(0, NPG)) < 0){
+    printf("%s: shmget failed\n", s);
+    exit(1);
+  }
+  if(mmap(0, (NPG+1)*4096, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0) != (char*)-1){
+    printf("%s: mapped past the end of a segment\n", s);
+    exit(1);
+  }
+  if(read(fd, &i, 1) != -1 || write(fd, &i, 1) != -1){
+    printf("%s: read or write of a segment fd did not fail\n", s);
+    exit(1);
+  }
+  p = mmap(0, NPG*4096, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  if(p == (char*)-1){
+    printf("%s: mmap failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < NPG*4096; i++){
+    if(p[i] != 0){
+      printf("%s: segment not zeroed\n", s);
+      exit(1);
+    }
+  }
+  close(fd);
+  if((pid = fork()) < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    for(i = 0; i < NPG; i++)
+      p[i*4096] = 'a' + i;
+    exit(0);
+  }
+  wait(0);
+  for(i = 0; i < NPG; i++){
+    if(p[i*4096] != 'a' + i){
+      printf("%s: parent did not see the child's store\n", s);
+      exit(1);
+    }
+  }
+  munmap(p, NPG*4096);
+
+  // a child that closes the inherited descriptor finds
+  // the segment again by its key.
+  if((fd = shmget(key, 1)) < 0){
+    printf("%s: shmget of a key failed\n", s);
+    exit(1);
+  }
+  if(shmget(key, 2) != -1){
+    printf("%s: attached a segment larger than it is\n", s);
+    exit(1);
+  }
+  if((pid = fork()) < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    close(fd);
+    if((fd = shmget(key, 1)) < 0)
+      exit(1);
+    q = mmap(0, 4096, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    if(q == (char*)-1)
+      exit(1);
+    q[100] = 'K';
+    exit(0);
+  }
+  wait(&xstatus);
+  q = mmap(0, 4096, PROT_READ, MAP_SHARED, fd, 0);
+  if(xstatus != 0 || q == (char*)-1 || q[100] != 'K'){
+    printf("%s: segment not shared by key\n", s);
+    exit(1);
+  }
+  munmap(q, 4096);
+  close(fd);
+
+  // the last close freed it; the key now makes a new one.
+  if((fd = shmget(key, 1)) < 0 ||
+     (q = mmap(0, 4096, PROT_READ, MAP_SHARED, fd, 0)) == (char*)-1 ||
+     q[100] != 0){
+    printf("%s: segment outlived its last reference\n", s);
+    exit(1);
+  }
+  munmap(q, 4096);
+  close(fd);
+}
+
+// poll() waits for whichever pipe becomes ready first,
+// honours its timeout, and reports a closed writer;
+// O_NONBLOCK reads and writes fail instead of sleeping.
+void
+polltest(char *s)
+{
+  int a[2], b[2], pid, n, tot;
+  struct pollfd pfd[3];
+  char buf[100];
+
+  if(pipe(a) < 0 || pipe(b) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  pfd[0].fd = a[0];
+  pfd[0].events = POLLIN;
+  pfd[1].fd = b[0];
+  pfd[1].events = POLLIN;
+  pfd[2].fd = -1;
+  if(poll(pfd, 3, 0) != 0 || poll(pfd, 3, 100) != 0){
+    printf("%s: poll of empty pipes did not time out\n", s);
+    exit(1);
+  }
+
+  if((pid = fork()) < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    sleep(2);
+    write(b[1], "x", 1);
+    exit(0);
+  }
+  if(poll(pfd, 3, -1) != 1 || pfd[0].revents != 0 ||
+     pfd[1].revents != POLLIN || pfd[2].revents != 0){
+    printf("%s: poll did not report the written pipe\n", s);
+    exit(1);
+  }
+  wait(0);
+  if(read(b[0], buf, 1) != 1){
+    printf("%s: read failed\n", s);
+    exit(1);
+  }
+
+  // a non-blocking read of an empty pipe fails; a
+  // non-blocking writer fills the pipe and then fails.
+  if(fcntl(a[0], F_SETFL, O_NONBLOCK) != 0 ||
+     fcntl(a[1], F_SETFL, O_NONBLOCK) != 0 ||
+     (fcntl(a[0], F_GETFL, 0) & O_NONBLOCK) == 0){
+    printf("%s: fcntl failed\n", s);
+    exit(1);
+  }
+  if(read(a[0], buf, 1) != -1){
+    printf("%s: non-blocking read of an empty pipe\n", s);
+    exit(1);
+  }
+  tot = 0;
+  while((n = write(a[1], buf, sizeof(buf))) > 0)
+    tot += n;
+  if(tot == 0 || tot % sizeof(buf) == 0){
+    printf("%s: non-blocking write did not stop at a full pipe\n", s);
+    exit(1);
+  }
+  pfd[0].events = POLLIN|POLLOUT;
+  if(poll(pfd, 1, 0) != 1 || pfd[0].revents != POLLIN){
+    printf("%s: poll of a full pipe\n", s);
+    exit(1);
+  }
+
+  // closing the write end is a hangup.
+  close(a[1]);
+  close(b[1]);
+  pfd[0].events = 0;
+  if(poll(pfd, 2, -1) != 2 || pfd[0].revents != POLLHUP ||
+     pfd[1].revents != (POLLIN|POLLHUP)){
+    printf("%s: poll did not report a closed writer\n", s);
+    exit(1);
+  }
+  close(a[0]);
+  close(b[0]);
+  pfd[0].fd = a[0];
+  if(poll(pfd, 1, 0) != 1 || pfd[0].revents != POLLNVAL){
+    printf("%s: poll of a closed fd\n", s);
+    exit(1);
+  }
+}
+
+// how many CPUs are running: those that have taken interrupts.
+int
+countcpus(void)
+{
+  struct kstats ks;
+  int i, ncpu;
+
+  ncpu = 0;
+  for(i = 0; i < NCPU; i++)
+    if(kstats(i, &ks) == 0 && ks.n[ST_INTR] > 0)
+      ncpu++;
+  return ncpu > 0 ? ncpu : 1;
+}
+
+// a process restricted to one CPU makes all its system calls
+// there; the mask is inherited by fork() and can be read back.
+void
+affinitytest(char *s)
+{
+  enum { N = 50 };
+  struct kstats k0, k1;
+  int ncpu, cpu, i, pid, xstatus;
+
+  ncpu = countcpus();
+  if(setaffinity(0, 0) != -1 || setaffinity(0, 1 << NCPU) != -1){
+    printf("%s: setaffinity accepted a mask with no running CPU\n", s);
+    exit(1);
+  }
+  if(setaffinity(-1, 1) != -1 || getaffinity(-1) != -1){
+    printf("%s: affinity of a nonexistent process\n", s);
+    exit(1);
+  }
+  for(cpu = 0; cpu < ncpu; cpu++){
+    if(setaffinity(0, 1 << cpu) != 0 || getaffinity(0) != 1 << cpu){
+      printf("%s: setaffinity cpu %d failed\n", s, cpu);
+      exit(1);
+    }
+    kstats(cpu, &k0);
+    for(i = 0; i < N; i++)
+      sbrk(0);
+    kstats(cpu, &k1);
+    if(k1.n[ST_SYSCALL+SYS_sbrk] - k0.n[ST_SYSCALL+SYS_sbrk] < N){
+      printf("%s: system calls ran off cpu %d\n", s, cpu);
+      exit(1);
+    }
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0)
+    exit(getaffinity(0) == 1 << (ncpu-1) ? 0 : 1);
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: child did not inherit the mask\n", s);
+    exit(1);
+  }
+  setaffinity(0, (1 << NCPU) - 1);
+}
+
+// processes on two CPUs that take turns through pipes each
+// wake the other's idle CPU with an IPI, well within a tick,
+// rather than at its next timer interrupt.
+void
+ipitest(char *s)
+{
+  enum { N = 100 };
+  struct kstats k0, k1;
+  int ping[2], pong[2], i, pid, t0, t1, xstatus;
+  char c;
+
+  if(countcpus() < 2)
+    return;
+  if(pipe(ping) < 0 || pipe(pong) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    setaffinity(0, 1 << 1);
+    for(i = 0; i < N; i++)
+      if(read(ping[0], &c, 1) != 1 || write(pong[1], &c, 1) != 1)
+        exit(1);
+    exit(0);
+  }
+  setaffinity(0, 1 << 0);
+  kstats(-1, &k0);
+  t0 = uptime();
+  for(i = 0; i < N; i++){
+    if(write(ping[1], "x", 1) != 1 || read(pong[0], &c, 1) != 1){
+      printf("%s: ping-pong failed\n", s);
+      exit(1);
+    }
+  }
+  t1 = uptime();
+  kstats(-1, &k1);
+  wait(&xstatus);
+  setaffinity(0, (1 << NCPU) - 1);
+  close(ping[0]);
+  close(ping[1]);
+  close(pong[0]);
+  close(pong[1]);
+  if(xstatus != 0){
+    printf("%s: child failed\n", s);
+    exit(1);
+  }
+  if(k1.n[ST_IPI] == k0.n[ST_IPI]){
+    printf("%s: no IPIs\n", s);
+    exit(1);
+  }
+  if(t1 - t0 > N/2){
+    printf("%s: %d round trips took %d ticks\n", s, N, t1 - t0);
+    exit(1);
+  }
+}
+
+// test flags.
+#define SOLO 1  // run alone and in /: uses files in /, or most
+                // of memory, the disk, or the process table.
+
+struct test {
+  void (*f)(char *);
+  char *s;
+  int flags;
+} quicktests[] = {
+  {copyin, "copyin"},
+  {copyout, "copyout", SOLO},
+  {copyinstr1, "copyinstr1"},
+  {copyinstr2, "copyinstr2", SOLO},
+  {copyinstr3, "copyinstr3", SOLO},
+  {rwsbrk, "rwsbrk" },
+  {truncate1, "truncate1"},
+  {truncate2, "truncate2"},
+  {truncate3, "truncate3"},
+  {openiputtest, "openiput"},
+  {exitiputtest, "exitiput"},
+  {iputtest, "iput", SOLO},
+  {opentest, "opentest", SOLO},
+  {writetest, "writetest"},
+  {writebig, "writebig", SOLO},
+  {createtest, "createtest"},
+  {dirtest, "dirtest"},
+  {exectest, "exectest", SOLO},
+  {pipe1, "pipe1"},
+  {killstatus, "killstatus"},
+  {preempt, "preempt"},
+  {exitwait, "exitwait"},
+  {reparent, "reparent" },
+  {twochildren, "twochildren"},
+  {forkfork, "forkfork"},
+  {forkforkfork, "forkforkfork", SOLO},
+  {reparent2, "reparent2"},
+  {mem, "mem", SOLO},
+  {malloctest, "malloctest"},
+  {sharedfd, "sharedfd"},
+  {fourfiles, "fourfiles"},
+  {createdelete, "createdelete"},
+  {unlinkread, "unlinkread"},
+  {linktest, "linktest"},
+  {concreate, "concreate"},
+  {linkunlink, "linkunlink", SOLO},
+  {subdir, "subdir", SOLO},
+  {bigwrite, "bigwrite"},
+  {bigfile, "bigfile"},
+  {fourteen, "fourteen"},
+  {rmdot, "rmdot", SOLO},
+  {dirfile, "dirfile", SOLO},
+  {iref, "iref", SOLO},
+  {forktest, "forktest", SOLO},
+  {sbrkbasic, "sbrkbasic", SOLO},
+  {sbrkmuch, "sbrkmuch", SOLO},
+  {sbrkmega, "sbrkmega", SOLO},
+  {kernmem, "kernmem"},
+  {MAXVAplus, "MAXVAplus"},
+  {sbrkfail, "sbrkfail", SOLO},
+  {sbrkarg, "sbrkarg"},
+  {validatetest, "validatetest"},
+  {bsstest, "bsstest"},
+  {bigargtest, "bigargtest", SOLO},
+  {argptest, "argptest"},
+  {stacktest, "stacktest"},
+  {textwrite, "textwrite"},
+  {pgbug, "pgbug" },
+  {sbrkbugs, "sbrkbugs" },
+  {sbrklast, "sbrklast"},
+  {sbrk8000, "sbrk8000", SOLO},
+  {badarg, "badarg", SOLO},
+  {usleeptest, "usleeptest"},
+  {vdatatest, "vdatatest"},
+  {textcache, "textcache", SOLO},
+  {mmaptest, "mmaptest"},
+  {threadtest, "threadtest"},
+  {futextest, "futextest"},
+  {shmtest, "shmtest"},
+  {polltest, "polltest"},
+  {affinitytest, "affinitytest"},
+  {ipitest, "ipitest"},
+
+  { 0, 0},
+};
+
+//
+// Section with tests that take a fair bit of time
+//
+
+// directory that uses indirect blocks
+void
+bigdir(char *s)
+{
+  enum { N = 500 };
+  int i, fd;
+  char name[10];
+
+  unlink("bd");
+
+  fd = open("bd", O_CREATE);
+  if(fd < 0){
+    printf("%s: bigdir create failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  for(i = 0; i < N; i++){
+    name[0] = 'x';
+    name[1] = '0' + (i / 64);
+    name[2] = '0' + (i % 64);
+    name[3] = '\0';
+    if(link("bd", name) != 0){
+      printf("%s: bigdir link(bd, %s) failed\n", s, name);
+      exit(1);
+    }
+  }
+
+  unlink("bd");
+  for(i = 0; i < N; i++){
+    name[0] = 'x';
+    name[1] = '0' + (i / 64);
+    name[2] = '0' + (i % 64);
+    name[3] = '\0';
+    if(unlink(name) != 0){
+      printf("%s: bigdir unlink failed", s);
+      exit(1);
+    }
+  }
+}
+
+// concurrent writes to try to provoke deadlock in the virtio disk
+// driver.
+void
+manywrites(char *s)
+{
+  int nchildren = 4;
+  int howmany = 30; // increase to look for deadlock
+  
+  for(int ci = 0; ci < nchildren; ci++){
+    int pid = fork();
+    if(pid < 0){
+      printf("fork failed\n");
+      exit(1);
+    }
+
+    if(pid == 0){
+      char name[3];
+      name[0] = 'b';
+      name[1] = 'a' + ci;
+      name[2] = '\0';
+      unlink(name);
+      
+      for(int iters = 0; iters < howmany; iters++){
+        for(int i = 0; i < ci+1; i++){
+          int fd = open(name, O_CREATE | O_RDWR);
+          if(fd < 0){
+            printf("%s: cannot create %s\n", s, name);
+            exit(1);
+          }
+          int sz = sizeof(buf);
+          int cc = write(fd, buf, sz);
+          if(cc != sz){
+            printf("%s: write(%d) ret %d\n", s, sz, cc);
+            exit(1);
+          }
+          close(fd);
+        }
+        unlink(name);
+      }
+
+      unlink(name);
+      exit(0);
+    }
+  }
+
+  for(int ci = 0; ci < nchildren; ci++){
+    int st = 0;
+    wait(&st);
+    if(st != 0)
+      exit(st);
+  }
+  exit(0);
+}
+
+// regression test. does write() with an invalid buffer pointer cause
+// a block to be allocated for a file that is then not freed when the
+// file is deleted? if the kernel has this bug, it will panic: balloc:
+// out of blocks. assumed_free may need to be raised to be more than
+// the number of free blocks. this test takes a long time.
+void
+badwrite(char *s)
+{
+  int assumed_free = 600;
+  
+  unlink("junk");
+  for(int i = 0; i < assumed_free; i++){
+    int fd = open("junk", O_CREATE|O_WRONLY);
+    if(fd < 0){
+      printf("open junk failed\n");
+      exit(1);
+    }
+    write(fd, (char*)0xffffffffffL, 1);
+    close(fd);
+    unlink("junk");
+  }
+
+  int fd = open("junk", O_CREATE|O_WRONLY);
+  if(fd < 0){
+    printf("open junk failed\n");
+    exit(1);
+  }
+  if(write(fd, "x", 1) != 1){
+    printf("write failed\n");
+    exit(1);
+  }
+  close(fd);
+  unlink("junk");
+
+  exit(0);
+}
+
+// test the exec() code that cleans up if it runs out
+// of memory. it's really a test that such a condition
+// doesn't cause a panic.
+void
+execout(char *s)
+{
+  for(int avail = 0; avail < 15; avail++){
+    int pid = fork();
+    if(pid < 0){
+      printf("fork failed\n");
+      exit(1);
     } else if(pid == 0){
       // allocate all of memory.
       while(1){
@@ -2924,13 +3967,162 @@ outofinodes(char *s)
   }
 }
 
+// lock contention benchmark: one process per CPU calls the
+// uptime system call, which takes tickslock, as fast as it can
+// for a few seconds.  (uptime() itself reads VDATA, no lock.)
+// Prints total calls and the spread between the fastest and
+// slowest process; compare a TICKETLOCK=1 kernel against the
+// default at several CPUS= settings.
+void
+lockbench(char *s)
+{
+  enum { TICKS=30 };
+  int fds[2], ncpu, i, pid, t0, n, min, max, total;
+
+  ncpu = countcpus();
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  t0 = uptime() + 2;
+  for(i = 0; i < ncpu; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      close(fds[0]);
+      while(uptime() < t0)
+        ;
+      n = 0;
+      while(sysuptime() < t0 + TICKS)
+        n++;
+      write(fds[1], &n, sizeof(n));
+      exit(0);
+    }
+  }
+  close(fds[1]);
+
+  min = max = -1;
+  total = 0;
+  for(i = 0; i < ncpu; i++){
+    if(read(fds[0], &n, sizeof(n)) != sizeof(n)){
+      printf("%s: read failed\n", s);
+      exit(1);
+    }
+    if(min < 0 || n < min)
+      min = n;
+    if(n > max)
+      max = n;
+    total += n;
+    wait(0);
+  }
+  close(fds[0]);
+
+  printf("lockbench: %d cpus, %d calls, slowest %d fastest %d ... ",
+         ncpu, total, min, max);
+  if(min == 0){
+    printf("%s: a process was starved\n", s);
+    exit(1);
+  }
+}
+
+// scheduler benchmark: two CPU-bound processes per CPU, one of
+// each pair at nice 10, spin for a few seconds while this process
+// sleeps 10 ms at a time and measures how late it wakes.  Each
+// pair is pinned to its CPU, since nice only weighs processes
+// that share a CPU (see sched.c).  Prints
+// the nice 0 and nice 10 processes' shares of the work and the
+// average and worst wakeup latency.  Fails if nice makes no
+// difference, or if the sleeper ever waits more than a tick for
+// a CPU: it should run as soon as it wakes.
+void
+schedbench(char *s)
+{
+  enum { TICKS=30, NSLEEP=20, SLEEPUS=10000 };
+  struct kstats k0, k1;
+  int fds[2], ncpu, i, pid, t0, r[2], work[2];
+  uint64 lat, maxlat, totlat;
+
+  ncpu = countcpus();
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  t0 = uptime() + 2;
+  for(i = 0; i < 2*ncpu; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      close(fds[0]);
+      setaffinity(0, 1 << (i / 2));
+      r[0] = i % 2;
+      if(r[0])
+        nice(10);
+      while(uptime() < t0)
+        ;
+      r[1] = 0;
+      while(uptime() < t0 + TICKS)
+        r[1]++;
+      write(fds[1], r, sizeof(r));
+      exit(0);
+    }
+  }
+  close(fds[1]);
+
+  while(uptime() < t0 + 2)
+    sleep(1);
+  maxlat = totlat = 0;
+  for(i = 0; i < NSLEEP; i++){
+    kstats(-1, &k0);
+    usleep(SLEEPUS);
+    kstats(-1, &k1);
+    lat = k1.time - k0.time - SLEEPUS * (TIMEBASE / 1000000);
+    totlat += lat;
+    if(lat > maxlat)
+      maxlat = lat;
+  }
+
+  work[0] = work[1] = 0;
+  for(i = 0; i < 2*ncpu; i++){
+    if(read(fds[0], r, sizeof(r)) != sizeof(r)){
+      printf("%s: read failed\n", s);
+      exit(1);
+    }
+    work[r[0]] += r[1];
+    wait(0);
+  }
+  close(fds[0]);
+
+  printf("schedbench: %d cpus, nice 0 %d%% nice 10 %d%%, wakeup latency avg %dus max %dus ... ",
+         ncpu, (int)(100LL * work[0] / (work[0] + work[1] + 1)),
+         (int)(100LL * work[1] / (work[0] + work[1] + 1)),
+         (int)(totlat / NSLEEP / (TIMEBASE / 1000000)),
+         (int)(maxlat / (TIMEBASE / 1000000)));
+  if(work[0] < 2 * work[1]){
+    printf("%s: nice 10 got as much CPU as nice 0\n", s);
+    exit(1);
+  }
+  if(maxlat > TIMEBASE / HZ){
+    printf("%s: a waking process waited more than a tick\n", s);
+    exit(1);
+  }
+}
+
 struct test slowtests[] = {
   {bigdir, "bigdir"},
   {manywrites, "manywrites"},
-  {badwrite, "badwrite" },
-  {execout, "execout"},
-  {diskfull, "diskfull"},
-  {outofinodes, "outofinodes"},
+  {badwrite, "badwrite", SOLO},
+  {execout, "execout", SOLO},
+  {diskfull, "diskfull", SOLO},
+  {outofinodes, "outofinodes", SOLO},
+  {lockbench, "lockbench", SOLO},
+  {schedbench, "schedbench", SOLO},
     
   { 0, 0},
 };
@@ -2964,8 +4156,182 @@ run(void f(char *), char *s) {
   }
 }
 
+//
+// run tests in parallel
+//
+
+#define MAXJOBS 8
+
+// what a test's runner process reports back. small
+// enough to fit in a pipe's buffer, so the runner can
+// write it and exit without waiting for the parent.
+struct result {
+  int ok;
+  int ticks;
+  int n;          // bytes in out
+  char out[400];  // the start of the test's output
+};
+
+// run t in a child process, in directory dir if it is not 0,
+// with the child's output going to a pipe; then send the outcome
+// and output to fd as a struct result.
+void
+runner(struct test *t, char *dir, int fd)
+{
+  struct result r;
+  int p[2], pid, n, t0, xstatus;
+  char c[64];
+
+  if(dir){
+    mkdir(dir);  // may be left over from a failed test
+    if(chdir(dir) < 0){
+      printf("runner: cannot chdir to %s\n", dir);
+      exit(1);
+    }
+  }
+  if(pipe(p) < 0){
+    printf("runner: pipe failed\n");
+    exit(1);
+  }
+  t0 = uptime();
+  if((pid = fork()) < 0){
+    printf("runner: fork error\n");
+    exit(1);
+  }
+  if(pid == 0){
+    close(1);
+    close(2);
+    dup(p[1]);
+    dup(p[1]);
+    close(p[0]);
+    close(p[1]);
+    t->f(t->s);
+    exit(0);
+  }
+  close(p[1]);
+  r.n = 0;
+  while((n = read(p[0], c, sizeof(c))) > 0){
+    if(n > sizeof(r.out) - r.n)
+      n = sizeof(r.out) - r.n;
+    memmove(r.out + r.n, c, n);
+    r.n += n;
+  }
+  close(p[0]);
+  wait(&xstatus);
+  r.ticks = uptime() - t0;
+  r.ok = xstatus == 0;
+  write(fd, &r, sizeof(r));
+  if(dir){
+    chdir("..");
+    unlink(dir);
+  }
+  exit(0);
+}
+
+struct job {
+  int pid;            // runner, or 0 if the slot is free
+  int fd;             // read end of the runner's result pipe
+  struct test *t;
+} jobs[MAXJOBS];
+
+// start t in job slot j.
+void
+start(struct test *t, int j)
+{
+  static char dir[] = "utdir0";
+  int fds[2];
+
+  if(pipe(fds) < 0){
+    printf("start: pipe failed\n");
+    exit(1);
+  }
+  if((jobs[j].pid = fork()) < 0){
+    printf("start: fork error\n");
+    exit(1);
+  }
+  if(jobs[j].pid == 0){
+    close(fds[0]);
+    dir[5] = '0' + j;
+    runner(t, (t->flags & SOLO) ? 0 : dir, fds[1]);
+  }
+  close(fds[1]);
+  jobs[j].fd = fds[0];
+  jobs[j].t = t;
+}
+
+// wait for a job to finish and print its result.
+// returns 1 if the test passed.
+int
+reap(void)
+{
+  struct result r;
+  int pid, j, ok;
+
+  if((pid = wait(0)) < 0){
+    printf("reap: no jobs\n");
+    exit(1);
+  }
+  for(j = 0; j < MAXJOBS; j++)
+    if(jobs[j].pid == pid)
+      break;
+  if(j == MAXJOBS){
+    printf("reap: unknown child %d\n", pid);
+    exit(1);
+  }
+  printf("test %s: ", jobs[j].t->s);
+  ok = read(jobs[j].fd, &r, sizeof(r)) == sizeof(r);
+  if(ok){
+    write(1, r.out, r.n);
+    ok = r.ok;
+  }
+  if(ok)
+    printf("OK (%d ticks)\n", r.ticks);
+  else
+    printf("FAILED\n");
+  close(jobs[j].fd);
+  jobs[j].pid = 0;
+  return ok;
+}
+
+// like runtests, but with up to njobs tests at a time.
+// SOLO tests wait for the running ones and run alone.
+int
+runparallel(struct test *tests, char *justone, int njobs) {
+  int j, nrun = 0, failed = 0;
+
+  for (struct test *t = tests; t->s != 0; t++) {
+    if(justone != 0 && strcmp(t->s, justone) != 0)
+      continue;
+    while(nrun > 0 && (nrun == njobs || (t->flags & SOLO))){
+      failed |= !reap();
+      nrun--;
+    }
+    if(failed)
+      break;
+    for(j = 0; jobs[j].pid != 0; j++)
+      ;
+    start(t, j);
+    nrun++;
+    if(t->flags & SOLO){
+      failed |= !reap();
+      nrun--;
+    }
+  }
+  while(nrun > 0){
+    failed |= !reap();
+    nrun--;
+  }
+  if(failed){
+    printf("SOME TESTS FAILED\n");
+    return 1;
+  }
+  return 0;
+}
+
 int
-runtests(struct test *tests, char *justone) {
+runtests(struct test *tests, char *justone, int njobs) {
+  if(njobs > 1)
+    return runparallel(tests, justone, njobs);
   for (struct test *t = tests; t->s != 0; t++) {
     if((justone == 0) || strcmp(t->s, justone) == 0) {
       if(!run(t->f, t->s)){
@@ -3045,12 +4411,12 @@ countfree()
 }
 
 int
-drivetests(int quick, int continuous, char *justone) {
+drivetests(int quick, int continuous, char *justone, int njobs) {
   do {
     printf("usertests starting\n");
     int free0 = countfree();
     int free1 = 0;
-    if (runtests(quicktests, justone)) {
+    if (runtests(quicktests, justone, njobs)) {
       if(continuous != 2) {
         return 1;
       }
@@ -3058,7 +4424,7 @@ drivetests(int quick, int continuous, char *justone) {
     if(!quick) {
       if (justone == 0)
         printf("usertests slow tests starting\n");
-      if (runtests(slowtests, justone)) {
+      if (runtests(slowtests, justone, njobs)) {
         if(continuous != 2) {
           return 1;
         }
@@ -3079,21 +4445,30 @@ main(int argc, char *argv[])
 {
   int continuous = 0;
   int quick = 0;
+  int njobs = 1;
   char *justone = 0;
 
-  if(argc == 2 && strcmp(argv[1], "-q") == 0){
-    quick = 1;
-  } else if(argc == 2 && strcmp(argv[1], "-c") == 0){
-    continuous = 1;
-  } else if(argc == 2 && strcmp(argv[1], "-C") == 0){
-    continuous = 2;
-  } else if(argc == 2 && argv[1][0] != '-'){
-    justone = argv[1];
-  } else if(argc > 1){
-    printf("Usage: usertests [-c] [-C] [-q] [testname]\n");
-    exit(1);
+  for(int i = 1; i < argc; i++){
+    if(strcmp(argv[i], "-q") == 0){
+      quick = 1;
+    } else if(strcmp(argv[i], "-c") == 0){
+      continuous = 1;
+    } else if(strcmp(argv[i], "-C") == 0){
+      continuous = 2;
+    } else if(strcmp(argv[i], "-j") == 0 && i+1 < argc){
+      njobs = atoi(argv[++i]);
+      if(njobs < 1 || njobs > MAXJOBS){
+        printf("usertests: -j takes 1 to %d\n", MAXJOBS);
+        exit(1);
+      }
+    } else if(argv[i][0] != '-' && justone == 0){
+      justone = argv[i];
+    } else {
+      printf("Usage: usertests [-c] [-C] [-q] [-j N] [testname]\n");
+      exit(1);
+    }
   }
-  if (drivetests(quick, continuous, justone)) {
+  if (drivetests(quick, continuous, justone, njobs)) {
     exit(1);
   }
   printf("ALL TESTS PASSED\n");
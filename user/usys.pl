@@ -6,11 +6,14 @@ print "# generated by usys.pl - do not edit\n";
 
 print "#include \"kernel/syscall.h\"\n";
 
+# entry(name) makes name() call SYS_name;
+# entry(name, call) makes name() call SYS_call.
 sub entry {
     my $name = shift;
+    my $call = shift || $name;
     print ".global $name\n";
     print "${name}:\n";
-    print " li a7, SYS_${name}\n";
+    print " li a7, SYS_${call}\n";
     print " ecall\n";
     print " ret\n";
 }
@@ -32,7 +35,24 @@ entry("link");
 entry("mkdir");
 entry("chdir");
 entry("dup");
-entry("getpid");
 entry("sbrk");
 entry("sleep");
-entry("uptime");
+entry("kstats");
+entry("lockstat");
+entry("profctl");
+entry("profread");
+entry("usleep");
+entry("trace");
+entry("traceread");
+entry("mmap");
+entry("munmap");
+entry("clone");
+entry("join");
+entry("futex");
+entry("shmget");
+entry("poll");
+entry("fcntl");
+entry("nice");
+entry("setaffinity");
+entry("getaffinity");
+entry("sysuptime", "uptime");